@@ -0,0 +1,252 @@
+#!/usr/bin/env python3
+"""
+Generates an SMF state table and an O(1) (state, event) dispatch matrix from a
+PlantUML state diagram. Runs on the build host and fails the build when a leaf
+state leaves an event unhandled.
+"""
+
+import argparse
+import re
+import sys
+
+IDENT = r"[A-Za-z_]\w*"
+ARROW_RE = re.compile(r"^(\[\*\]|{0})\s+-+(?:\w+-+)?>\s+({0})(\[H\*?\])?\s*(?::\s*(.*))?$".format(IDENT))
+DESCRIPTION_RE = re.compile(r"^({0})\s*:\s*(.*)$".format(IDENT))
+ACTION_RE = re.compile(r"^({0})\s*/\s*({0})?$".format(IDENT))
+COMPOSITE_RE = re.compile(r"^state\s+({0})\s*\{{$".format(IDENT))
+DECLARATION_RE = re.compile(r"^state\s+({0})$".format(IDENT))
+
+
+class State:
+    def __init__(self, name, parent):
+        self.name = name
+        self.parent = parent
+        self.children = []
+        self.initial = None
+        self.entry = None
+        self.exit = None
+        self.transitions = {}  # event -> (target, history, action), history is None, "[H]" or "[H*]"
+
+
+class Diagram:
+    def __init__(self):
+        self.states = {}
+        self.order = []
+        self.initial = None
+        self.events = []
+
+    def state(self, name, parent):
+        if name not in self.states:
+            self.states[name] = State(name, parent)
+            self.order.append(name)
+            if parent:
+                self.states[parent].children.append(name)
+        return self.states[name]
+
+    def event(self, name):
+        if name not in self.events:
+            self.events.append(name)
+
+
+def fail(path, number, message):
+    sys.exit("smf_table.py: {}:{}: {}".format(path, number, message))
+
+
+def add_transition(diagram, path, number, source, event, transition):
+    if event in source.transitions:
+        fail(path, number, "{} already handles {}".format(source.name, event))
+    source.transitions[event] = transition
+    diagram.event(event)
+
+
+def parse(path):
+    diagram = Diagram()
+    scope = [None]  # Enclosing composite states, None is the top level
+
+    with open(path) as f:
+        lines = f.readlines()
+
+    for number, raw in enumerate(lines, 1):
+        line = raw.strip()
+        if not line or line.startswith("'") or line.startswith("@"):
+            continue
+
+        match = COMPOSITE_RE.match(line)
+        if match:
+            diagram.state(match.group(1), scope[-1])
+            scope.append(match.group(1))
+            continue
+        if line == "}":
+            if len(scope) == 1:
+                fail(path, number, "unbalanced }")
+            scope.pop()
+            continue
+        match = DECLARATION_RE.match(line)
+        if match:
+            diagram.state(match.group(1), scope[-1])
+            continue
+
+        match = ARROW_RE.match(line)
+        if match:
+            source, target, history, label = match.groups()
+            diagram.state(target, scope[-1])
+            if source == "[*]":
+                if scope[-1] is None:
+                    diagram.initial = target
+                else:
+                    diagram.states[scope[-1]].initial = target
+                continue
+            action = ACTION_RE.match(label or "") or re.match(r"^({0})$".format(IDENT), label or "")
+            if not action:
+                fail(path, number, "transition label has to be 'EVENT' or 'EVENT / action'")
+            transition = (target, history, action.group(2) if action.lastindex > 1 else None)
+            add_transition(diagram, path, number, diagram.state(source, scope[-1]), action.group(1), transition)
+            continue
+
+        match = DESCRIPTION_RE.match(line)
+        if match:
+            state = diagram.state(match.group(1), scope[-1])
+            action = ACTION_RE.match(match.group(2))
+            if not action:
+                continue  # Plain description
+            if action.group(1) in ("entry", "exit"):
+                if not action.group(2):
+                    fail(path, number, "{} / needs a function".format(action.group(1)))
+                setattr(state, action.group(1), action.group(2))
+            else:
+                add_transition(diagram, path, number, state, action.group(1), (None, None, action.group(2)))
+            continue
+
+        fail(path, number, "can't parse '{}'".format(line))
+
+    if len(scope) != 1:
+        fail(path, len(lines), "missing }")
+    return diagram
+
+
+def check(diagram):
+    if diagram.initial is None:
+        return "the diagram needs a top level [*] transition"
+    for state in diagram.states.values():
+        if state.children and state.initial is None:
+            return "composite {} needs a [*] transition".format(state.name)
+        for event, (target, history, _) in state.transitions.items():
+            if history and not diagram.states[target].children:
+                return "{}{} isn't a composite state".format(target, history)
+
+    # Every leaf resolves every event itself or through one of its parents
+    for state in diagram.states.values():
+        if state.children:
+            continue
+        for event in diagram.events:
+            handler = state
+            while handler is not None and event not in handler.transitions:
+                handler = diagram.states[handler.parent] if handler.parent else None
+            if handler is None:
+                return "{} doesn't handle {}, add '{} : {} /' to ignore it".format(
+                    state.name, event, state.name, event)
+    return None
+
+
+def render(diagram, prefix, source):
+    guard = "{}_SM_TABLE_H".format(prefix.upper())
+    states = "{}_states".format(prefix)
+    no_target = "{}_SM_NO_TARGET".format(prefix.upper())
+    out = []
+    out.append("/*\nGenerated by smf_table.py from {}, do not edit\n*/\n".format(source))
+    out.append("#ifndef {0}\n#define {0}\n".format(guard))
+    out.append("#include <stdbool.h>\n#include <stdint.h>\n#include <zephyr/smf.h>\n")
+
+    out.append("enum {}_sm_state {{".format(prefix))
+    out.extend("  {},".format(name) for name in diagram.order)
+    out.append("  {}_SM_NUM_STATES,\n}};\n".format(prefix.upper()))
+
+    out.append("enum {}_sm_event {{".format(prefix))
+    out.extend("  {},".format(name) for name in diagram.events)
+    out.append("  {}_SM_NUM_EVENTS,\n}};\n".format(prefix.upper()))
+
+    out.append("#define {}_SM_INITIAL {}".format(prefix.upper(), diagram.initial))
+    out.append("#define {} -1\n".format(no_target))
+
+    out.append("typedef enum {0}_sm_history_t {{\n"
+               "  {1}_SM_HISTORY_NONE = 0,\n"
+               "  {1}_SM_HISTORY_SHALLOW, // [H], child of the composite target that was last active\n"
+               "  {1}_SM_HISTORY_DEEP, // [H*], leaf of the composite target that was last active\n"
+               "}} {0}_sm_history;\n".format(prefix, prefix.upper()))
+    out.append("typedef struct {0}_sm_transition_t {{\n"
+               "  bool handled; // false propagates the event to the parent state\n"
+               "  uint8_t history; // {0}_sm_history of the target\n"
+               "  int8_t target; // {1} for internal transitions\n"
+               "  void (*action)(void *o); // Runs before the source state is left\n"
+               "}} {0}_sm_transition;\n".format(prefix, no_target))
+
+    functions = []
+    for name in diagram.order:
+        state = diagram.states[name]
+        functions += [state.entry, state.exit] + [t[2] for t in state.transitions.values()]
+    out.append("// Implemented by the file including this table")
+    out.append("static enum smf_state_result {0}_sm_dispatch(void *o, enum {0}_sm_state state);".format(prefix))
+    for function in sorted(set(f for f in functions if f)):
+        out.append("static void {}(void *o);".format(function))
+    out.append("")
+
+    for name in diagram.order:
+        out.append("static enum smf_state_result {0}_run(void *o) {{ return {1}_sm_dispatch(o, {0}); }}".format(name, prefix))
+    out.append("")
+
+    out.append("static const struct smf_state {}[{}_SM_NUM_STATES] = {{".format(states, prefix.upper()))
+    for name in diagram.order:
+        state = diagram.states[name]
+        out.append("  [{}] = SMF_CREATE_STATE({}, {}_run, {}, {}, {}),".format(
+            name, state.entry or "NULL", name, state.exit or "NULL",
+            "&{}[{}]".format(states, state.parent) if state.parent else "NULL",
+            "&{}[{}]".format(states, state.initial) if state.initial else "NULL"))
+    out.append("};\n")
+
+    out.append("static const {0}_sm_transition {0}_transitions[{1}_SM_NUM_STATES][{1}_SM_NUM_EVENTS] = {{".format(
+        prefix, prefix.upper()))
+    for name in diagram.order:
+        state = diagram.states[name]
+        if not state.transitions:
+            continue
+        out.append("  [{}] = {{".format(name))
+        for event in diagram.events:
+            if event not in state.transitions:
+                continue
+            target, history, action = state.transitions[event]
+            history = {None: "NONE", "[H]": "SHALLOW", "[H*]": "DEEP"}[history]
+            out.append("    [{}] = {{.handled=true, .history={}_SM_HISTORY_{}, .target={}, .action={}}},".format(
+                event, prefix.upper(), history, target or no_target, action or "NULL"))
+        out.append("  },")
+    out.append("};\n")
+
+    out.append("// For traces and shells, never needed to run the machine")
+    out.append("static const char *const {}_sm_state_names[{}_SM_NUM_STATES] = {{".format(prefix, prefix.upper()))
+    out.extend("  \"{}\",".format(name) for name in diagram.order)
+    out.append("};")
+    out.append("static const char *const {}_sm_event_names[{}_SM_NUM_EVENTS] = {{".format(prefix, prefix.upper()))
+    out.extend("  \"{}\",".format(name) for name in diagram.events)
+    out.append("};\n")
+
+    out.append("#endif")
+    return "\n".join(out) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--input", required=True, help="PlantUML state diagram")
+    parser.add_argument("--prefix", required=True, help="prefix of the generated names")
+    parser.add_argument("--output", required=True, help="header to write")
+    args = parser.parse_args()
+
+    diagram = parse(args.input)
+    error = check(diagram)
+    if error:
+        sys.exit("smf_table.py: {}: {}".format(args.input, error))
+
+    with open(args.output, "w") as f:
+        f.write(render(diagram, args.prefix, args.input.replace("\\", "/").split("/")[-1]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,147 @@
+/*
+ * ascii_buffer.c
+ *
+ * Ring buffer behind the ASCII entry feature. The size and what happens when it is
+ * full are set in Kconfig, listeners get each character as it is appended so nothing
+ * has to reprint the whole string.
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+#include "ascii_buffer.h"
+
+#define BUFFER_MASK   (CONFIG_APP_ASCII_BUFFER_SIZE - 1)
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_APP_ASCII_BUFFER_SIZE), "CONFIG_APP_ASCII_BUFFER_SIZE must be a power of two");
+
+static char data[CONFIG_APP_ASCII_BUFFER_SIZE];
+static uint32_t head = 0;   // characters appended since boot
+static uint32_t tail = 0;   // position of the oldest character kept
+static atomic_t lost = ATOMIC_INIT(0);   // dropped, overwritten or timed out
+static struct k_spinlock lock;
+static sys_slist_t listeners = SYS_SLIST_STATIC_INIT(&listeners);
+
+#ifdef CONFIG_APP_ASCII_OVERFLOW_BLOCK
+K_SEM_DEFINE(space, 0, 1);   // given whenever characters are consumed or cleared
+#endif
+
+/**
+ * @brief Appends one character and tells the listeners. What happens on a full buffer depends
+ *        on the overflow policy: drop the new character, overwrite the oldest, or wait for the
+ *        exporter to consume some
+ *
+ * @return 0 on success, -ENOSPC if dropped, -EAGAIN if blocking timed out
+ */
+int ascii_buffer_append(char c)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    while (head - tail == CONFIG_APP_ASCII_BUFFER_SIZE) {
+#if defined(CONFIG_APP_ASCII_OVERFLOW_OVERWRITE)
+        tail++;
+        atomic_inc(&lost);
+#elif defined(CONFIG_APP_ASCII_OVERFLOW_BLOCK)
+        k_spin_unlock(&lock, key);
+        if (0 != k_sem_take(&space, K_MSEC(CONFIG_APP_ASCII_BLOCK_TIMEOUT_MS))) {
+            atomic_inc(&lost);
+            return -EAGAIN;
+        }
+        key = k_spin_lock(&lock);
+#else
+        k_spin_unlock(&lock, key);
+        atomic_inc(&lost);
+        return -ENOSPC;
+#endif
+    }
+    uint32_t position = head;
+    data[head++ & BUFFER_MASK] = c;
+    k_spin_unlock(&lock, key);
+
+    ascii_buffer_listener *listener;
+    SYS_SLIST_FOR_EACH_CONTAINER(&listeners, listener, node) {
+        if (listener->appended) {
+            listener->appended(c, position, listener->user_data);
+        }
+    }
+    return 0;
+}
+
+void ascii_buffer_clear(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    tail = head;
+    k_spin_unlock(&lock, key);
+#ifdef CONFIG_APP_ASCII_OVERFLOW_BLOCK
+    k_sem_give(&space);
+#endif
+
+    ascii_buffer_listener *listener;
+    SYS_SLIST_FOR_EACH_CONTAINER(&listeners, listener, node) {
+        if (listener->cleared) {
+            listener->cleared(listener->user_data);
+        }
+    }
+}
+
+size_t ascii_buffer_len(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    size_t len = head - tail;
+    k_spin_unlock(&lock, key);
+    return len;
+}
+
+/**
+ * @brief Copies characters out without removing them, offset 0 is the oldest one kept
+ *
+ * @return Number of characters copied, 0 past the end
+ */
+int ascii_buffer_read(size_t offset, char *out, size_t len)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    size_t available = head - tail;
+    len = offset < available ? MIN(len, available - offset) : 0;
+
+    // At most two pieces, the second one starts over at the front of the ring
+    uint32_t start = (tail + offset) & BUFFER_MASK;
+    size_t first = MIN(len, (size_t)CONFIG_APP_ASCII_BUFFER_SIZE - start);
+    memcpy(out, &data[start], first);
+    memcpy(out + first, data, len - first);
+    k_spin_unlock(&lock, key);
+    return len;
+}
+
+// Positions of the oldest character kept and of the next one appended, both count appends since boot
+void ascii_buffer_span(uint32_t *start, uint32_t *end)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    *start = tail;
+    *end = head;
+    k_spin_unlock(&lock, key);
+}
+
+// Drops every character before position end once the exporter has sent them, frees room for
+// blocked appends. Never moves back past characters already dropped or forward past the newest
+void ascii_buffer_consume(uint32_t end)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    if ((int32_t)(end - tail) > 0) {
+        tail += MIN(end - tail, head - tail);
+    }
+    k_spin_unlock(&lock, key);
+#ifdef CONFIG_APP_ASCII_OVERFLOW_BLOCK
+    k_sem_give(&space);
+#endif
+}
+
+// Characters dropped, overwritten or timed out since boot
+uint32_t ascii_buffer_lost(void)
+{
+    return (uint32_t)atomic_get(&lost);
+}
+
+// Listeners are expected to be added once at init and never removed
+void ascii_buffer_listen(ascii_buffer_listener *listener)
+{
+    sys_slist_append(&listeners, &listener->node);
+}
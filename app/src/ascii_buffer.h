@@ -0,0 +1,28 @@
+/**
+ * @file ascii_buffer.h
+ */
+
+#ifndef ASCII_BUFFER_H
+#define ASCII_BUFFER_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/slist.h>
+
+// Told about every change as it happens, so exports only ever send what is new
+typedef struct ascii_buffer_listener {
+    sys_snode_t node;
+    void (*appended)(char c, uint32_t position, void *user_data);   // position counts appends since boot
+    void (*cleared)(void *user_data);
+    void *user_data;
+} ascii_buffer_listener;
+
+int ascii_buffer_append(char c);
+void ascii_buffer_clear(void);
+size_t ascii_buffer_len(void);
+int ascii_buffer_read(size_t offset, char *out, size_t len);
+void ascii_buffer_span(uint32_t *start, uint32_t *end);
+void ascii_buffer_consume(uint32_t end);
+uint32_t ascii_buffer_lost(void);
+void ascii_buffer_listen(ascii_buffer_listener *listener);
+
+#endif //ASCII_BUFFER_H
@@ -0,0 +1,705 @@
+/*
+ * ble_service.c
+ *
+ * Custom GATT service: the read/write characteristic plus a notify-only stream of the
+ * ASCII string and the state machine's state changes. Each connection stages its records
+ * and packs them into MTU-sized notifications once per connection interval, keeping several
+ * queued so the controller can send them all in the same connection event.
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/uuid.h>
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include "LED.h"
+#include "ascii_buffer.h"
+#include "ble_service.h"
+#include "my_state_machine.h"
+#include "remote_input.h"
+
+#define BLE_CUSTOM_SERVICE_UUID \
+    BT_UUID_128_ENCODE(0x12345678, 0x1234, 0x5678, 0x1234, 0x56789abcdef0)
+
+#define BLE_CUSTOM_CHARACTERISTIC_UUID \
+    BT_UUID_128_ENCODE(0x12345678, 0x1234, 0x5678, 0x1234, 0x56789abcdef2)
+
+#define BLE_STREAM_CHARACTERISTIC_UUID \
+    BT_UUID_128_ENCODE(0x12345678, 0x1234, 0x5678, 0x1234, 0x56789abcdef3)
+
+#define BLE_LED_FRAME_CHARACTERISTIC_UUID \
+    BT_UUID_128_ENCODE(0x12345678, 0x1234, 0x5678, 0x1234, 0x56789abcdef4)
+
+#define BLE_BUTTON_CHARACTERISTIC_UUID \
+    BT_UUID_128_ENCODE(0x12345678, 0x1234, 0x5678, 0x1234, 0x56789abcdef5)
+
+#define STREAM_PAYLOAD_MAX    (CONFIG_BT_L2CAP_TX_MTU - 3)   // ATT notification header
+#define SNAPSHOT_CHUNK        32                              // characters per snapshot record
+
+// Link parameters asked for on connect, setup time runs until all three have settled
+#define NEGOTIATED_MTU        BIT(0)
+#define NEGOTIATED_DATA_LEN   BIT(1)
+#define NEGOTIATED_PHY        BIT(2)
+#define NEGOTIATED_ALL        (NEGOTIATED_MTU | NEGOTIATED_DATA_LEN | NEGOTIATED_PHY)
+
+static const struct bt_data ble_advertising_data[] = {
+  BT_DATA_BYTES(BT_DATA_FLAGS(BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+  BT_DATA(BT_DATA_NAME_COMPLETE, CONFIG_BT_DEVICE_NAME, sizeof(CONFIG_BT_DEVICE_NAME)-1),
+};
+
+static struct bt_uuid_128 ble_custom_service_uuid = BT_UUID_INIT_128(BLE_CUSTOM_SERVICE_UUID);
+static struct bt_uuid_128 ble_custom_characteristic_uuid = BT_UUID_INIT_128(BLE_CUSTOM_CHARACTERISTIC_UUID);
+static struct bt_uuid_128 ble_stream_characteristic_uuid = BT_UUID_INIT_128(BLE_STREAM_CHARACTERISTIC_UUID);
+static struct bt_uuid_128 ble_led_frame_characteristic_uuid = BT_UUID_INIT_128(BLE_LED_FRAME_CHARACTERISTIC_UUID);
+static struct bt_uuid_128 ble_button_characteristic_uuid = BT_UUID_INIT_128(BLE_BUTTON_CHARACTERISTIC_UUID);
+
+static uint8_t ble_custom_characteristic_user_data[20] = {};
+
+/* ---------- types ---------- */
+typedef struct {
+    struct bt_conn *conn;          // NULL when the slot is free
+    bool subscribed;               // stream notifications enabled by the client
+    uint16_t payload;              // notification payload the negotiated MTU allows
+    uint32_t interval_us;          // connection interval, how long records wait to be batched
+    struct k_spinlock lock;        // staging is filled by the state machine thread
+    struct ring_buf staging;
+    uint8_t staging_data[CONFIG_APP_BLE_STREAM_BUFFER_SIZE];
+    struct k_work_delayable flush;
+    struct bt_gatt_exchange_params mtu_params;
+    atomic_t in_flight;            // notifications queued and not yet sent
+    uint16_t pending[CONFIG_APP_BLE_STREAM_IN_FLIGHT];   // their lengths, sent in order
+    uint32_t pending_cycles[CONFIG_APP_BLE_STREAM_IN_FLIGHT];   // and when they were queued
+    uint32_t latency_max_us;       // longest a notification waited from queued to sent
+    uint32_t queued;               // notifications queued since connecting
+    uint32_t sent;                 // notifications sent since connecting
+    uint32_t bytes;                // payload bytes sent since connecting
+    uint32_t dropped;              // records that found the staging buffer full
+    uint32_t staged_end;           // string position after the last character staged
+    uint32_t exported;             // string characters before this position are sent
+    int64_t first_queued_ms;       // uptime of the first notification queued
+    int64_t last_sent_ms;          // uptime of the last notification sent
+    int64_t connected_ms;          // uptime of the connection
+    atomic_t negotiated;           // NEGOTIATED_* settled, successfully or not
+    uint16_t mtu;
+    uint16_t tx_len;               // link layer payload
+    uint8_t phy;
+} ble_link;
+
+static ble_link links[CONFIG_BT_MAX_CONN];
+static int64_t advertising_ms;     // uptime advertising last started
+
+static void advertise(struct k_work *work);
+static K_WORK_DEFINE(advertise_work, advertise);
+
+/* ---------- metrics ---------- */
+#ifdef CONFIG_APP_BLE_METRICS
+// One "ble_metric <name>=<value> conn=<index>" line per measurement, for scripts reading the console
+static void metric(const ble_link *link, const char *name, uint32_t value)
+{
+    printk("ble_metric %s=%u conn=%d\n", name, value, (int)(link - links));
+}
+#else
+static inline void metric(const ble_link *link, const char *name, uint32_t value)
+{
+    ARG_UNUSED(link);
+    ARG_UNUSED(name);
+    ARG_UNUSED(value);
+}
+#endif
+
+static void negotiated(ble_link *link, atomic_val_t step)
+{
+    atomic_val_t before = atomic_or(&link->negotiated, step);
+    if (before != NEGOTIATED_ALL && (before | step) == NEGOTIATED_ALL) {
+        metric(link, "setup_ms", k_uptime_get() - link->connected_ms);
+        metric(link, "mtu", link->mtu);
+        metric(link, "tx_len", link->tx_len);
+        metric(link, "phy", link->phy);
+    }
+}
+
+/* ---------- custom characteristic ---------- */
+static ssize_t custom_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                           void *buf, uint16_t len, uint16_t offset)
+{
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, attr->user_data,
+                             sizeof(ble_custom_characteristic_user_data));
+}
+
+static ssize_t custom_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                            const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+    if (offset + len > sizeof(ble_custom_characteristic_user_data)) {
+        return BT_GATT_ERR(offset > sizeof(ble_custom_characteristic_user_data) ?
+                           BT_ATT_ERR_INVALID_OFFSET : BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+    memcpy((uint8_t *)attr->user_data + offset, buf, len);
+    return len;
+}
+
+/* ---------- LED frame characteristic ---------- */
+// One entry per LED, little-endian: u8 led, u8 curve, u16 from, u16 to, u16 duration_ms.
+// Levels are perceived brightness, a duration of 0 sets the LED to `to` right away
+#define LED_FRAME_ENTRY_SIZE   8
+
+// The whole write becomes one LED_fade_many() frame, a bad entry drops the frame
+static ssize_t led_frame_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                               const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+    const uint8_t *entry = buf;
+    led_fade fades[NUM_LEDS];
+    uint32_t led_mask = 0;
+
+    if (offset != 0) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    } else if (len == 0 || len % LED_FRAME_ENTRY_SIZE != 0) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+    for (; entry < (const uint8_t *)buf + len; entry += LED_FRAME_ENTRY_SIZE) {
+        uint8_t led = entry[0];
+        if (led >= NUM_LEDS || entry[1] > LED_CURVE_EASE_IN_OUT) {
+            return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+        }
+        fades[led] = (led_fade){
+            .curve = entry[1],
+            .from = sys_get_le16(&entry[2]),
+            .to = sys_get_le16(&entry[4]),
+            .duration_ms = sys_get_le16(&entry[6]),
+        };
+        led_mask |= BIT(led);   // a later entry for the same LED wins
+    }
+
+    if (0 != LED_fade_many(led_mask, fades)) {
+        return BT_GATT_ERR(BT_ATT_ERR_UNLIKELY);
+    }
+    return len;
+}
+
+/* ---------- button characteristic ---------- */
+// One entry per press or release, little-endian: u8 button, u8 pressed, u32 time_us. The time
+// is an offset from the write's arrival, each event is injected that much later. Offsets never
+// go down within a write, so a press/release sequence replays its gestures and chords
+#define BUTTON_ENTRY_SIZE   6
+
+// Every entry goes into the remote input queue in order, a full queue stops the burst there
+static ssize_t button_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                            const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+    int64_t arrived = k_uptime_ticks();
+    const uint8_t *end = (const uint8_t *)buf + len;
+    uint32_t previous_us = 0;
+
+    if (offset != 0) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    } else if (len == 0 || len % BUTTON_ENTRY_SIZE != 0) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+    for (const uint8_t *entry = buf; entry < end; entry += BUTTON_ENTRY_SIZE) {
+        uint32_t time_us = sys_get_le32(&entry[2]);
+        if (entry[0] >= NUM_BTNS || time_us < previous_us) {
+            return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+        }
+        previous_us = time_us;
+    }
+    // All or nothing, a retry of a refused write can't repeat the part that got through
+    if (0 != remote_input_reserve(len / BUTTON_ENTRY_SIZE)) {
+        return BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES);
+    }
+    for (const uint8_t *entry = buf; entry < end; entry += BUTTON_ENTRY_SIZE) {
+        int64_t due = arrived + k_us_to_ticks_ceil64(sys_get_le32(&entry[2]));
+        remote_input_post_reserved(entry[0], entry[1] != 0, due);
+    }
+    return len;
+}
+
+static void stream_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value);
+
+BT_GATT_SERVICE_DEFINE(ble_custom_service,
+    BT_GATT_PRIMARY_SERVICE(&ble_custom_service_uuid),
+    BT_GATT_CHARACTERISTIC(&ble_custom_characteristic_uuid.uuid,
+                           BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
+                           BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
+                           custom_read, custom_write, ble_custom_characteristic_user_data),
+    BT_GATT_CHARACTERISTIC(&ble_stream_characteristic_uuid.uuid,
+                           BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_NONE, NULL, NULL, NULL),
+    BT_GATT_CCC(stream_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+    BT_GATT_CHARACTERISTIC(&ble_led_frame_characteristic_uuid.uuid,
+                           BT_GATT_CHRC_WRITE_WITHOUT_RESP, BT_GATT_PERM_WRITE,
+                           NULL, led_frame_write, NULL),
+    BT_GATT_CHARACTERISTIC(&ble_button_characteristic_uuid.uuid,
+                           BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP, BT_GATT_PERM_WRITE,
+                           NULL, button_write, NULL),
+);
+
+#define STREAM_ATTR   (&ble_custom_service.attrs[4])   // value of the stream characteristic
+
+/* ---------- stream ---------- */
+// Under the BLOCK overflow policy the string buffer only keeps characters a subscribed connection
+// still has to send, give back what all of them are done with
+static void stream_release(void)
+{
+    if (!IS_ENABLED(CONFIG_APP_ASCII_OVERFLOW_BLOCK)) {
+        return;
+    }
+    bool any = false;
+    uint32_t end = 0;
+
+    for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+        ble_link *link = &links[i];
+
+        k_spinlock_key_t key = k_spin_lock(&link->lock);
+        if (link->conn && link->subscribed) {
+            if (!any || (int32_t)(link->exported - end) < 0) {
+                end = link->exported;
+            }
+            any = true;
+        }
+        k_spin_unlock(&link->lock, key);
+    }
+    if (any) {
+        ascii_buffer_consume(end);
+    }
+}
+
+// A connection is done with every character it staged once nothing is staged or in flight
+static void stream_exported(ble_link *link)
+{
+    if (!IS_ENABLED(CONFIG_APP_ASCII_OVERFLOW_BLOCK)) {
+        return;
+    }
+    k_spinlock_key_t key = k_spin_lock(&link->lock);
+    bool done = ring_buf_is_empty(&link->staging) && 0 == atomic_get(&link->in_flight);
+    if (done) {
+        link->exported = link->staged_end;
+    }
+    k_spin_unlock(&link->lock, key);
+
+    if (done) {
+        stream_release();
+    }
+}
+
+static void stream_sent(struct bt_conn *conn, void *user_data)
+{
+    ble_link *link = user_data;
+
+    uint32_t slot = link->sent % CONFIG_APP_BLE_STREAM_IN_FLIGHT;
+    uint32_t waited_us = k_cyc_to_us_floor32(k_cycle_get_32() - link->pending_cycles[slot]);
+
+    link->bytes += link->pending[slot];
+    link->latency_max_us = MAX(link->latency_max_us, waited_us);
+    link->sent++;
+    link->last_sent_ms = k_uptime_get();
+    atomic_dec(&link->in_flight);
+
+    // A slot opened up, top the controller's queue back up if records are waiting
+    if (!ring_buf_is_empty(&link->staging)) {
+        k_work_reschedule(&link->flush, K_NO_WAIT);
+    }
+    stream_exported(link);
+}
+
+// Packs the staged records into as many full notifications as the in-flight limit allows
+static void stream_flush(struct k_work *work)
+{
+    ble_link *link = CONTAINER_OF(k_work_delayable_from_work(work), ble_link, flush);
+    uint8_t payload[STREAM_PAYLOAD_MAX];
+
+    while (atomic_get(&link->in_flight) < CONFIG_APP_BLE_STREAM_IN_FLIGHT) {
+        // Our own reference, disconnected() may drop the link's as soon as the lock is let go
+        struct bt_conn *conn = NULL;
+        uint32_t len = 0;
+        k_spinlock_key_t key = k_spin_lock(&link->lock);
+        if (link->conn && link->subscribed) {
+            len = ring_buf_peek(&link->staging, payload, link->payload);
+            conn = len ? bt_conn_ref(link->conn) : NULL;
+        }
+        k_spin_unlock(&link->lock, key);
+        if (!conn) {
+            return;
+        }
+
+        struct bt_gatt_notify_params params = {
+            .attr = STREAM_ATTR,
+            .data = payload,
+            .len = len,
+            .func = stream_sent,
+            .user_data = link,
+        };
+        if (link->queued == 0) {
+            link->first_queued_ms = k_uptime_get();
+        }
+        link->pending[link->queued % CONFIG_APP_BLE_STREAM_IN_FLIGHT] = len;
+        link->pending_cycles[link->queued % CONFIG_APP_BLE_STREAM_IN_FLIGHT] = k_cycle_get_32();
+        atomic_inc(&link->in_flight);
+        int err = bt_gatt_notify_cb(conn, &params);
+        bt_conn_unref(conn);
+        if (0 != err) {
+            // Out of buffers, the records stay staged and go with the next connection event
+            atomic_dec(&link->in_flight);
+            k_work_schedule(&link->flush, K_USEC(link->interval_us));
+            return;
+        }
+        link->queued++;
+
+        key = k_spin_lock(&link->lock);
+        ring_buf_get(&link->staging, NULL, len);
+        k_spin_unlock(&link->lock, key);
+        stream_exported(link);   // in case the last notification was already sent
+    }
+}
+
+/**
+ * @brief Stages one record for every subscribed connection. Records wait up to one connection
+ *        interval to be batched with the ones after them, a full notification goes right away
+ *
+ * @param [in] record Whole record, never split when the staging buffer is short on room
+ */
+static void stream_push(const uint8_t *record, uint32_t len)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+        ble_link *link = &links[i];
+
+        k_spinlock_key_t key = k_spin_lock(&link->lock);
+        if (!link->conn || !link->subscribed) {
+            k_spin_unlock(&link->lock, key);
+            continue;
+        }
+        bool staged = ring_buf_space_get(&link->staging) >= len;
+        if (staged) {
+            ring_buf_put(&link->staging, record, len);
+        } else {
+            link->dropped++;
+        }
+        bool full = ring_buf_size_get(&link->staging) >= link->payload;
+        k_timeout_t batch = K_USEC(link->interval_us);
+        k_spin_unlock(&link->lock, key);
+
+        if (full) {
+            k_work_reschedule(&link->flush, K_NO_WAIT);
+        } else if (staged) {
+            k_work_schedule(&link->flush, batch);   // no-op while a batch is already open
+        }
+    }
+}
+
+// Sends the string as it is right now, later characters follow as they are appended
+static void stream_snapshot(ble_link *link)
+{
+    uint8_t record[2 + SNAPSHOT_CHUNK];
+    size_t offset = 0;
+    int len;
+
+    record[0] = BLE_STREAM_SNAPSHOT;
+    while (0 < (len = ascii_buffer_read(offset, (char *)&record[2], SNAPSHOT_CHUNK))) {
+        record[1] = len;
+        k_spinlock_key_t key = k_spin_lock(&link->lock);
+        if (ring_buf_space_get(&link->staging) >= (uint32_t)(2 + len)) {
+            ring_buf_put(&link->staging, record, 2 + len);
+        } else {
+            link->dropped++;
+        }
+        k_spin_unlock(&link->lock, key);
+        offset += len;
+    }
+    k_work_reschedule(&link->flush, K_NO_WAIT);
+}
+
+static void stream_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+    // The CCC callback doesn't say which connection wrote it, ask each one
+    for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+        ble_link *link = &links[i];
+        if (!link->conn) {
+            continue;
+        }
+        bool subscribed = bt_gatt_is_subscribed(link->conn, STREAM_ATTR, BT_GATT_CCC_NOTIFY);
+        bool subscribing = subscribed && !link->subscribed;
+
+        k_spinlock_key_t key = k_spin_lock(&link->lock);
+        link->subscribed = subscribed;
+        if (!subscribed) {
+            ring_buf_reset(&link->staging);
+        } else if (subscribing) {
+            // The snapshot holds everything kept until it is sent
+            ascii_buffer_span(&link->exported, &link->staged_end);
+        }
+        k_spin_unlock(&link->lock, key);
+
+        if (subscribing) {
+            stream_snapshot(link);
+        } else if (!subscribed) {
+            stream_release();   // the others may be further along
+        }
+    }
+}
+
+static void stream_appended(char c, uint32_t position, void *user_data)
+{
+    uint8_t record[6] = {BLE_STREAM_CHAR};
+
+    sys_put_le32(position, &record[1]);
+    record[5] = c;
+    stream_push(record, sizeof(record));
+
+    // Dropped or staged, the connection is done with the character once its staging runs dry
+    for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+        k_spinlock_key_t key = k_spin_lock(&links[i].lock);
+        links[i].staged_end = position + 1;
+        k_spin_unlock(&links[i].lock, key);
+    }
+}
+
+static void stream_cleared(void *user_data)
+{
+    const uint8_t record[1] = {BLE_STREAM_CLEARED};
+
+    stream_push(record, sizeof(record));
+}
+
+static void stream_state_changed(uint8_t from, uint8_t to, uint8_t event, void *user_data)
+{
+    uint8_t record[8] = {BLE_STREAM_STATE};
+
+    sys_put_le32(k_uptime_get_32(), &record[1]);
+    record[5] = from;
+    record[6] = to;
+    record[7] = event;
+    stream_push(record, sizeof(record));
+}
+
+static ascii_buffer_listener stream_ascii_listener = {
+    .appended = stream_appended,
+    .cleared = stream_cleared,
+};
+
+static sm_listener stream_sm_listener = {.changed = stream_state_changed};
+
+/* ---------- throughput ---------- */
+static void throughput_format(const ble_link *link, char *out, size_t len)
+{
+    uint32_t ms = link->last_sent_ms - link->first_queued_ms;
+    if (link->sent == 0 || ms == 0) {
+        snprintk(out, len, "%u notifications, too few to time", link->sent);
+        return;
+    }
+    // Bytes per millisecond is kB/s
+    uint32_t centi_kbps = (uint64_t)link->bytes * 100 / ms;
+    snprintk(out, len, "%u notifications, %u bytes in %u ms = %u.%02u kB/s, %u records dropped",
+             link->sent, link->bytes, ms, centi_kbps / 100, centi_kbps % 100, link->dropped);
+}
+
+/* ---------- connection ---------- */
+static void mtu_exchanged(struct bt_conn *conn, uint8_t err, struct bt_gatt_exchange_params *params)
+{
+    if (err) {
+        printk("BLE MTU exchange failed (0x%02x)\n", err);
+        negotiated(&links[bt_conn_index(conn)], NEGOTIATED_MTU);
+    }
+}
+
+static void att_mtu_updated(struct bt_conn *conn, uint16_t tx, uint16_t rx)
+{
+    ble_link *link = &links[bt_conn_index(conn)];
+
+    k_spinlock_key_t key = k_spin_lock(&link->lock);
+    link->payload = MIN(bt_gatt_get_mtu(conn) - 3, STREAM_PAYLOAD_MAX);
+    k_spin_unlock(&link->lock, key);
+    link->mtu = bt_gatt_get_mtu(conn);
+    printk("BLE MTU %u, notifications carry %u bytes\n", link->mtu, link->payload);
+    negotiated(link, NEGOTIATED_MTU);
+}
+
+static struct bt_gatt_cb gatt_callbacks = {
+    .att_mtu_updated = att_mtu_updated,
+};
+
+// Asks for everything that raises throughput, the central has the last word on each
+static void negotiate(ble_link *link)
+{
+    int err;
+
+    link->mtu_params.func = mtu_exchanged;
+    err = bt_gatt_exchange_mtu(link->conn, &link->mtu_params);
+    if (err) {
+        printk("BLE MTU exchange not started (%d)\n", err);
+        negotiated(link, NEGOTIATED_MTU);
+    }
+    err = bt_conn_le_data_len_update(link->conn, BT_LE_DATA_LEN_PARAM_MAX);
+    if (err) {
+        printk("BLE data length update not started (%d)\n", err);
+        negotiated(link, NEGOTIATED_DATA_LEN);
+    }
+    err = bt_conn_le_phy_update(link->conn, BT_CONN_LE_PHY_PARAM_2M);
+    if (err) {
+        printk("BLE PHY update not started (%d)\n", err);
+        negotiated(link, NEGOTIATED_PHY);
+    }
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+    if (err) {
+        printk("BLE connection failed (0x%02x)\n", err);
+        return;
+    }
+    ble_link *link = &links[bt_conn_index(conn)];
+    struct bt_conn_info info;
+    bt_conn_get_info(conn, &info);
+
+    k_spinlock_key_t key = k_spin_lock(&link->lock);
+    link->conn = bt_conn_ref(conn);
+    link->subscribed = false;
+    link->payload = BT_ATT_DEFAULT_LE_MTU - 3;
+    link->interval_us = BT_CONN_INTERVAL_TO_US(info.le.interval);
+    ring_buf_reset(&link->staging);
+    k_spin_unlock(&link->lock, key);
+    atomic_set(&link->in_flight, 0);
+    link->queued = 0;
+    link->sent = 0;
+    link->bytes = 0;
+    link->dropped = 0;
+    link->latency_max_us = 0;
+    link->connected_ms = k_uptime_get();
+    atomic_set(&link->negotiated, 0);
+    link->mtu = BT_ATT_DEFAULT_LE_MTU;
+    link->tx_len = BT_GAP_DATA_LEN_DEFAULT;
+    link->phy = BT_GAP_LE_PHY_1M;
+
+    printk("BLE connected, interval %u us\n", link->interval_us);
+    metric(link, "adv_to_connect_ms", link->connected_ms - advertising_ms);
+    negotiate(link);
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+    ble_link *link = &links[bt_conn_index(conn)];
+    struct k_work_sync sync;
+
+    k_spinlock_key_t key = k_spin_lock(&link->lock);
+    link->subscribed = false;
+    k_spin_unlock(&link->lock, key);
+    k_work_cancel_delayable_sync(&link->flush, &sync);
+
+    char throughput[96];
+    throughput_format(link, throughput, sizeof(throughput));
+    printk("BLE disconnected (0x%02x), stream: %s\n", reason, throughput);
+    uint32_t ms = link->last_sent_ms - link->first_queued_ms;
+    metric(link, "stream_notifications", link->sent);
+    metric(link, "stream_bytes", link->bytes);
+    metric(link, "stream_bytes_per_s", (link->sent && ms) ? (uint64_t)link->bytes * 1000 / ms : 0);
+    metric(link, "stream_latency_max_us", link->latency_max_us);
+    metric(link, "stream_dropped", link->dropped);
+
+    led_latency frames;
+    LED_latency_get(&frames);
+    metric(link, "led_frames", frames.count);
+    metric(link, "led_frame_latency_max_us", frames.max_us);
+
+    key = k_spin_lock(&link->lock);
+    bt_conn_unref(link->conn);
+    link->conn = NULL;
+    k_spin_unlock(&link->lock, key);
+    stream_release();   // this connection no longer holds characters back
+}
+
+static void recycled(void)
+{
+    // The connection object is free again, so advertising can take it
+    k_work_submit(&advertise_work);
+}
+
+static void le_param_updated(struct bt_conn *conn, uint16_t interval, uint16_t latency, uint16_t timeout)
+{
+    ble_link *link = &links[bt_conn_index(conn)];
+
+    k_spinlock_key_t key = k_spin_lock(&link->lock);
+    link->interval_us = BT_CONN_INTERVAL_TO_US(interval);
+    k_spin_unlock(&link->lock, key);
+    printk("BLE interval %u us, latency %u, timeout %u ms\n", link->interval_us, latency, timeout * 10);
+}
+
+static void le_data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info)
+{
+    ble_link *link = &links[bt_conn_index(conn)];
+
+    printk("BLE data length tx %u bytes / %u us, rx %u bytes / %u us\n",
+           info->tx_max_len, info->tx_max_time, info->rx_max_len, info->rx_max_time);
+    link->tx_len = info->tx_max_len;
+    negotiated(link, NEGOTIATED_DATA_LEN);
+}
+
+static void le_phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *info)
+{
+    ble_link *link = &links[bt_conn_index(conn)];
+
+    printk("BLE PHY tx %u, rx %u\n", info->tx_phy, info->rx_phy);
+    link->phy = info->tx_phy;
+    negotiated(link, NEGOTIATED_PHY);
+}
+
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+    .connected = connected,
+    .disconnected = disconnected,
+    .recycled = recycled,
+    .le_param_updated = le_param_updated,
+    .le_data_len_updated = le_data_len_updated,
+    .le_phy_updated = le_phy_updated,
+};
+
+static void advertise(struct k_work *work)
+{
+    advertising_ms = k_uptime_get();
+    int err = bt_le_adv_start(BT_LE_ADV_CONN_FAST_1, ble_advertising_data,
+                              ARRAY_SIZE(ble_advertising_data), NULL, 0);
+    if (err && err != -EALREADY) {
+        printk("BLE advertising failed to start (%d)\n", err);
+    }
+}
+
+/* ---------- API ---------- */
+int ble_service_init(void)
+{
+    int err = bt_enable(NULL);
+    if (err) {
+        printk("Bluetooth init failed (%d)\n", err);
+        return err;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+        ring_buf_init(&links[i].staging, sizeof(links[i].staging_data), links[i].staging_data);
+        k_work_init_delayable(&links[i].flush, stream_flush);
+    }
+    bt_gatt_cb_register(&gatt_callbacks);
+    ascii_buffer_listen(&stream_ascii_listener);
+    state_machine_listen(&stream_sm_listener);
+
+    advertise(NULL);
+    return 0;
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_ble_stats(const struct shell *sh, size_t argc, char **argv)
+{
+    char throughput[96];
+
+    for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+        if (links[i].conn) {
+            throughput_format(&links[i], throughput, sizeof(throughput));
+            shell_print(sh, "Connection %zu: %s", i, throughput);
+        }
+    }
+    return 0;
+}
+
+SHELL_CMD_REGISTER(ble, NULL, "Stream throughput of the open connections", cmd_ble_stats);
+#endif
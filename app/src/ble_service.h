@@ -0,0 +1,21 @@
+/**
+ * @file ble_service.h
+ */
+
+#ifndef BLE_SERVICE_H
+#define BLE_SERVICE_H
+
+#include <zephyr/kernel.h>
+
+// Stream characteristic records, little-endian and back to back. A record may span two
+// notifications, a client reassembles them as one byte stream
+typedef enum {
+    BLE_STREAM_CHAR     = 0x01,   // u32 position, char
+    BLE_STREAM_CLEARED  = 0x02,   // nothing
+    BLE_STREAM_STATE    = 0x03,   // u32 uptime ms, u8 from, u8 to, u8 event (trace encoding)
+    BLE_STREAM_SNAPSHOT = 0x04,   // u8 length, characters: the string as it was on subscribe
+} ble_stream_record;
+
+int ble_service_init(void);
+
+#endif //BLE_SERVICE_H
@@ -0,0 +1,43 @@
+/*
+ * btn_shell.c
+ *
+ * "btn" shell commands for the button driver: press latency of the debounce backend and
+ * what the buttons and the event queue are doing right now. remote_input.c adds
+ * "btn inject" to the same set.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+
+#include "BTN.h"
+
+static int cmd_btn_latency(const struct shell *sh, size_t argc, char **argv)
+{
+    btn_latency stats;
+
+    BTN_latency_get(&stats);
+    if (stats.count == 0) {
+        shell_print(sh, "No presses measured yet");
+        return 0;
+    }
+    shell_print(sh, "%u presses, last %u us, max %u us, mean %u us", stats.count, stats.last_us,
+                stats.max_us, (uint32_t)(stats.total_us / stats.count));
+    return 0;
+}
+
+static int cmd_btn_state(const struct shell *sh, size_t argc, char **argv)
+{
+    uint32_t mask = BTN_get_mask();   // one read per port, buttons sharing one are seen together
+
+    for (int i = 0; i < NUM_BTNS; i++) {
+        shell_print(sh, "BTN%d: %s", i, (mask & BIT(i)) ? "pressed" : "released");
+    }
+    shell_print(sh, "Events dropped on a full queue: %u", BTN_event_overflows());
+    return 0;
+}
+
+SHELL_SUBCMD_ADD((btn), latency, NULL, "Press latency of the debounce backend", cmd_btn_latency, 1, 0);
+SHELL_SUBCMD_ADD((btn), state, NULL, "Raw button levels and event queue overflows", cmd_btn_state, 1, 0);
+
+SHELL_SUBCMD_SET_CREATE(sub_btn, (btn));
+SHELL_CMD_REGISTER(btn, &sub_btn, "Button commands", NULL);
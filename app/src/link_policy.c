@@ -0,0 +1,117 @@
+/*
+ * link_policy.c
+ *
+ * Connection parameters and PHY follow what the user is doing: short intervals without
+ * latency while bits are being entered, long intervals with high latency in standby.
+ * Speeding up happens right away, slowing down waits until the activity has stayed low
+ * for a while so a short pause doesn't cost two parameter updates.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+
+#include "link_policy.h"
+#include "my_state_machine.h"
+
+#define SLOW_DOWN_DELAY_MS   2000   // how long the activity stays lower before the link follows
+#define CONNECT_SETTLE_MS    1000   // lets the MTU, data length and PHY negotiation finish first
+
+typedef struct {
+    const char *name;
+    struct bt_le_conn_param param;   // intervals in 1.25 ms units, timeout in 10 ms units
+    uint8_t phy;                     // BT_GAP_LE_PHY_*
+} link_profile;
+
+// Indexed by sm_activity, faster profiles come first
+static const link_profile profiles[] = {
+    [SM_ACTIVITY_ENTRY] = {
+        .name = "entry",
+        .param = {.interval_min = 6, .interval_max = 12, .latency = 0, .timeout = 400},   // 7.5 - 15 ms
+        .phy = BT_GAP_LE_PHY_2M,
+    },
+    [SM_ACTIVITY_IDLE] = {
+        .name = "idle",
+        .param = {.interval_min = 24, .interval_max = 40, .latency = 4, .timeout = 400},   // 30 - 50 ms
+        .phy = BT_GAP_LE_PHY_2M,
+    },
+    // 1M hears the central a few dB further out, a missed event costs most at these intervals
+    [SM_ACTIVITY_STANDBY] = {
+        .name = "standby",
+        .param = {.interval_min = 400, .interval_max = 640, .latency = 3, .timeout = 800},   // 0.5 - 0.8 s
+        .phy = BT_GAP_LE_PHY_1M,
+    },
+};
+
+static atomic_t activity = ATOMIC_INIT(SM_ACTIVITY_IDLE);   // the profile the links follow
+
+static void apply(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(apply_work, apply);
+
+static void apply_conn(struct bt_conn *conn, void *data)
+{
+    const link_profile *profile = data;
+    struct bt_conn_info info;
+
+    if (0 != bt_conn_get_info(conn, &info) || info.state != BT_CONN_STATE_CONNECTED) {
+        return;
+    }
+
+    // -EALREADY: the link is inside the profile's interval range already
+    int err = bt_conn_le_param_update(conn, &profile->param);
+    if (err && err != -EALREADY) {
+        printk("BLE link policy: parameter update not started (%d)\n", err);
+    }
+
+    struct bt_conn_le_phy_param phy = {
+        .options = BT_CONN_LE_PHY_OPT_NONE,
+        .pref_tx_phy = profile->phy,
+        .pref_rx_phy = profile->phy,
+    };
+    err = bt_conn_le_phy_update(conn, &phy);
+    if (err) {
+        printk("BLE link policy: PHY update not started (%d)\n", err);
+    }
+}
+
+static void apply(struct k_work *work)
+{
+    const link_profile *profile = &profiles[atomic_get(&activity)];
+
+    printk("BLE link policy: %s\n", profile->name);
+    bt_conn_foreach(BT_CONN_TYPE_LE, apply_conn, (void *)profile);
+}
+
+static void activity_changed(uint8_t from, uint8_t to, uint8_t event, void *user_data)
+{
+    sm_activity now = state_machine_activity();
+    sm_activity before = atomic_set(&activity, now);
+
+    if (now < before) {
+        k_work_reschedule(&apply_work, K_NO_WAIT);
+    } else if (now > before) {
+        k_work_reschedule(&apply_work, K_MSEC(SLOW_DOWN_DELAY_MS));
+    }
+}
+
+static sm_listener activity_listener = {.changed = activity_changed};
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+    if (!err) {
+        k_work_reschedule(&apply_work, K_MSEC(CONNECT_SETTLE_MS));
+    }
+}
+
+BT_CONN_CB_DEFINE(link_policy_callbacks) = {
+    .connected = connected,
+};
+
+// After state_machine_init(), from the same thread
+void link_policy_init(void)
+{
+    atomic_set(&activity, state_machine_activity());
+    state_machine_listen(&activity_listener);
+}
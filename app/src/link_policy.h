@@ -0,0 +1,10 @@
+/**
+ * @file link_policy.h
+ */
+
+#ifndef LINK_POLICY_H
+#define LINK_POLICY_H
+
+void link_policy_init(void);
+
+#endif //LINK_POLICY_H
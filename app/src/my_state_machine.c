@@ -1,14 +1,87 @@
+#include <string.h>
 #include <zephyr/smf.h>
+#include <zephyr/sys/atomic.h>
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+#ifdef CONFIG_APP_SM_STATS
+#include <zephyr/stats/stats.h>
+#endif
 
 #include "LED.h"
+#include "ascii_buffer.h"
 #include "my_state_machine.h"
 #include "BTN.h"
+#include "my_state_machine_table.h"   // generated from my_state_machine.puml
 
 /* ---------- helpers ---------- */
-static inline bool b0(void){ return BTN_check_clear_pressed(BTN0); }
-static inline bool b1(void){ return BTN_check_clear_pressed(BTN1); }
-static inline bool b2(void){ return BTN_check_clear_pressed(BTN2); }
-static inline bool b3(void){ return BTN_check_clear_pressed(BTN3); }
+// Holding BTN0/BTN1 auto-repeats the bit, holding BTN2 wipes the whole string
+#define BIT_REPEAT_DELAY_MS     400
+#define BIT_REPEAT_INTERVAL_MS  150
+#define CLEAR_ALL_HOLD_MS       1000
+
+// Standby chord: BTN0 + BTN1 pressed together, reported by the BTN driver as one event
+#define STANDBY_CHORD      (BIT(BTN0) | BIT(BTN1))
+#define CHORD_WINDOW_MS    80     // how close together the two presses have to land
+
+// Button events the diagram uses, everything else never reaches the states
+static const struct {
+    btn_event_type type;
+    btn_id btn;
+    enum led_sm_event event;
+} button_events[] = {
+    {BTN_EVENT_PRESS,      BTN0, EVT_B0_PRESS},
+    {BTN_EVENT_PRESS,      BTN1, EVT_B1_PRESS},
+    {BTN_EVENT_PRESS,      BTN2, EVT_B2_PRESS},
+    {BTN_EVENT_PRESS,      BTN3, EVT_B3_PRESS},
+    {BTN_EVENT_REPEAT,     BTN0, EVT_B0_REPEAT},
+    {BTN_EVENT_REPEAT,     BTN1, EVT_B1_REPEAT},
+    {BTN_EVENT_LONG_PRESS, BTN2, EVT_B2_LONG},
+};
+
+// Diagram event being dispatched, LED_SM_NUM_EVENTS when the run was triggered by a timeout
+static enum led_sm_event current_event = LED_SM_NUM_EVENTS;
+
+static enum led_sm_event event_of(const btn_event *evt){
+    if (!evt) {
+        return LED_SM_NUM_EVENTS;
+    }
+    if (evt->type == BTN_EVENT_CHORD) {
+        return evt->mask == STANDBY_CHORD ? EVT_CHORD : LED_SM_NUM_EVENTS;
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(button_events); i++) {
+        if (button_events[i].type == evt->type && button_events[i].btn == evt->btn) {
+            return button_events[i].event;
+        }
+    }
+    return LED_SM_NUM_EVENTS;
+}
+
+// Writes several LEDs as one frame so they all change in the same PWM period
+#define ALL_LEDS        LED_MASK_ALL
+#define BIT_LEDS        (BIT(LED0) | BIT(LED1))
+
+static void leds_show(uint32_t led_mask, uint32_t on_mask){
+    uint8_t duty_cycles[NUM_LEDS];
+    for (int i = 0; i < NUM_LEDS; i++) {
+        duty_cycles[i] = (on_mask & BIT(i)) ? 100 : 0;
+    }
+    // A failed stage is never committed, so the LEDs keep the last whole frame
+    int err = LED_set_many(led_mask, duty_cycles);
+    if (!err) {
+        err = LED_commit();
+    }
+    if (err) {
+        printk("LED frame not shown (%d)\n", err);
+    }
+}
+
+// Starts a blink or breath, the LED driver reports what it couldn't queue
+static void leds_check(int err, led_id led){
+    if (err) {
+        printk("LED%d waveform not started (%d)\n", led + 1, err);
+    }
+}
 
 /* ---------- ASCII CODE FUNCTIONS ---------- */
 /* 
@@ -20,9 +93,7 @@ static inline bool b3(void){ return BTN_check_clear_pressed(BTN3); }
  //Global Variables
 static uint8_t ascii_code = 0;   // stores the 8-bit ASCII being built
 static uint8_t bit_index = 0;    // how many bits have been entered (0–7)
-#define MAX_STRING_LEN 32    // you can change this
-static char ascii_string[MAX_STRING_LEN + 1];   // +1 for null terminator
-static uint8_t ascii_string_len = 0;
+// Saved characters live in ascii_buffer, sized and overflow-handled through Kconfig
 
  
 static void ascii_add_bit(uint8_t bit)
@@ -39,17 +110,14 @@ static void ascii_add_bit(uint8_t bit)
 
         /* ---- LED feedback ----- */
         if (bit == 0) {
-            LED_set(LED0, LED_ON);
-            LED_set(LED1, LED_OFF);
+            leds_show(BIT_LEDS, BIT(LED0));
         } else {
-            LED_set(LED1, LED_ON);
-            LED_set(LED0, LED_OFF);
+            leds_show(BIT_LEDS, BIT(LED1));
         }
 
     } else {
         // Already have 8 bits → blink both LEDs quickly
-        LED_set(LED0, LED_ON);
-        LED_set(LED1, LED_ON);
+        leds_show(BIT_LEDS, BIT_LEDS);
         // You can optionally ignore new bits or wrap, up to you
     }
 }
@@ -59,8 +127,7 @@ static void ascii_clear(void)
     ascii_code = 0;
     bit_index  = 0;
 
-    LED_set(LED0, LED_OFF);
-    LED_set(LED1, LED_OFF);
+    leds_show(BIT_LEDS, 0);
 }
 
 static void ascii_save_code(void)
@@ -71,10 +138,9 @@ static void ascii_save_code(void)
         // Convert the 8-bit value into an ASCII character
         char c = (char)ascii_code;
 
-        // Store character into buffer if space available
-        if (ascii_string_len < MAX_STRING_LEN) {
-            ascii_string[ascii_string_len++] = c;
-            ascii_string[ascii_string_len]   = '\0';   // maintain null termination
+        // Store character into buffer, the listeners export it
+        if (0 > ascii_buffer_append(c)) {
+            printk("String buffer full, '%c' was not saved (%u lost so far).\n", c, ascii_buffer_lost());
         }
 
         // Clear out for next ASCII entry
@@ -82,343 +148,458 @@ static void ascii_save_code(void)
     }
     else {
         // Optional: blink LEDs to indicate "not complete"
-        LED_set(LED0, LED_ON);
-        LED_set(LED1, LED_ON);
+        leds_show(BIT_LEDS, BIT_LEDS);
         // You could also choose to ignore this case
     }
 }
 
 static void ascii_string_clear(void)
 {
-    ascii_string_len = 0;     // no characters stored
-    ascii_string[0]  = '\0';  // empty string
+    ascii_buffer_clear();
 }
 
-/* ---- PWM breathing parameters ---- */
-#define PULSE_STEP       2      // change per update (brightness smoothness)
-#define PULSE_MAX        100    // full brightness (0–100%)
-#define PULSE_MIN        0      // off brightness
-#define PULSE_UPDATE_MS  10     // speed of pulsing (lower = faster)
-
-/* ---- Breathing state ---- */
-static uint8_t pulse_brightness = 0;
-static bool pulse_rising = true;
-static uint16_t pulse_count = 0;
-
-/* ---- Call this frequently (every run cycle) ---- */
-static void pulse_all_leds(void)
+// Console export: only the character just saved goes out, never the whole string again
+static void console_appended(char c, uint32_t position, void *user_data)
 {
-    // Delay between each brightness change
-    if (++pulse_count < PULSE_UPDATE_MS) {
-        return;
-    }
-    pulse_count = 0;
-
-    // Increase or decrease brightness
-    if (pulse_rising) {
-        if (pulse_brightness < PULSE_MAX) {
-            pulse_brightness += PULSE_STEP;
-        } else {
-            pulse_rising = false;   // reached max → start falling
-        }
-    } 
-    else { // falling
-        if (pulse_brightness > PULSE_MIN) {
-            pulse_brightness -= PULSE_STEP;
-        } else {
-            pulse_rising = true;    // reached min → start rising
-        }
-    }
-
-    // Apply brightness to all 4 LEDs
-    LED_pwm(LED0, pulse_brightness);
-    LED_pwm(LED1, pulse_brightness);
-    LED_pwm(LED2, pulse_brightness);
-    LED_pwm(LED3, pulse_brightness);
+    ARG_UNUSED(user_data);
+    printk("Saved char %u: %c\n", position, c);
 }
 
-/* ---------- timing ---------- */
-#define TOGGLE4_MS    125   // 4 cycles/sec -> toggle every 125 ms
-#define TOGGLE16_MS    31   // ~16 cycles/sec -> toggle every ~31 ms
-#define TOGGLE1_MS     500 // 1 cycle/sec
-
-/* ---------- prototypes ---------- */
-
-static void state0_entry(void *o);
-static enum smf_state_result state0_run (void *o);
-static void state0_exit(void *o);
-
-static void state1_entry(void *o);
-static enum smf_state_result state1_run (void *o);
-static void state1_exit(void *o);
+static ascii_buffer_listener console_listener = {.appended = console_appended};
 
-static void state2_entry(void *o);
-static enum smf_state_result state2_run (void *o);
-static void state2_exit(void *o);
-
-static void state3_entry(void *o);
-static enum smf_state_result state3_run (void *o);
-static void state3_exit(void *o);
+/* ---- PWM breathing parameters ---- */
+#define PULSE_MAX        100    // full brightness (0–100%)
+#define PULSE_MIN        0      // off brightness
+#define PULSE_PERIOD_MS  1000   // one full breath, off → full → off
 
 /* ---------- types ---------- */
-enum led_state_machine_states{ 
-    State_0,        // LED3 blink @ 1 Hz
-    State_1,        // LED3 blink @ 4HZ
-    State_2,        // LED3 blink @ 16HZ
-    State_3         // LEDS Pulse
-};
-
 typedef struct {
     struct smf_ctx ctx;  // must be first
-    uint16_t count;      // ms-ish counter used per state
-    bool phase;          // general toggle phase
-    uint8_t previous_state;   // NEW: remember where standby should return
+    const struct smf_state *history[LED_SM_NUM_STATES];   // last active leaf of each composite state
 } led_state_object_t;
 
+static led_state_object_t led_state_object; 
 
-/* ---------- state table ---------- */
-static const struct smf_state led_states[] = {
-    [State_0]       = SMF_CREATE_STATE(state0_entry,        state0_run,        state0_exit,        NULL, NULL),
-    [State_1]       = SMF_CREATE_STATE(state1_entry,        state1_run,        state1_exit,        NULL, NULL),
-    [State_2]       = SMF_CREATE_STATE(state2_entry,        state2_run,        state2_exit,        NULL, NULL),
-    [State_3]       = SMF_CREATE_STATE(state3_entry,        state3_run,        state3_exit,        NULL, NULL)
-}; 
+static sys_slist_t sm_listeners = SYS_SLIST_STATIC_INIT(&sm_listeners);
 
-static led_state_object_t led_state_object; 
+static void notify_listeners(const struct smf_state *from, const struct smf_state *to, enum led_sm_event event){
+    sm_listener *listener;
+    SYS_SLIST_FOR_EACH_CONTAINER(&sm_listeners, listener, node) {
+        listener->changed(from ? from - led_states : LED_SM_NUM_STATES, to - led_states, event, listener->user_data);
+    }
+}
 
-/* ---------- API ---------- */
-void state_machine_init(){
-    led_state_object.count = 0; 
-    led_state_object.phase = false;
-    smf_set_initial(SMF_CTX(&led_state_object), &led_states[State_0]);
+/* ---------- trace ---------- */
+#ifdef CONFIG_APP_SM_TRACE
+#define TRACE_MASK    (CONFIG_APP_SM_TRACE_SIZE - 1)
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_APP_SM_TRACE_SIZE), "CONFIG_APP_SM_TRACE_SIZE must be a power of two");
+
+// Written by the state machine thread only, readers copy it out and drop whatever got overwritten meanwhile
+static sm_trace_record trace_ring[CONFIG_APP_SM_TRACE_SIZE];
+static atomic_t trace_head = ATOMIC_INIT(0);   // records written since boot
+
+static inline void trace_record(const struct smf_state *from, const struct smf_state *to, enum led_sm_event event){
+    uint32_t head = atomic_get(&trace_head);
+    sm_trace_record *r = &trace_ring[head & TRACE_MASK];
+    r->timestamp = k_cycle_get_32();
+    r->from = from ? from - led_states : LED_SM_NUM_STATES;
+    r->to = to - led_states;
+    r->event = event;
+    atomic_set(&trace_head, head + 1);   // publishes the record
 }
-int state_machine_run(){
-    return smf_run_state(SMF_CTX(&led_state_object));
+#else
+static inline void trace_record(const struct smf_state *from, const struct smf_state *to, enum led_sm_event event){
+    ARG_UNUSED(from);
+    ARG_UNUSED(to);
+    ARG_UNUSED(event);
 }
+#endif
 
+/* ---------- dispatch ---------- */
+static bool state_within(const struct smf_state *state, const struct smf_state *ancestor){
+    for (; state; state = state->parent) {
+        if (state == ancestor) {
+            return true;
+        }
+    }
+    return false;
+}
 
-/* ================= State_0: ================= */
-static void state0_entry(void* o)
-{
-    led_state_object_t *s = o;
-    s->count = 0;
-    s->phase = false;
+// Records the current leaf as the history of every composite the transition leaves
+static void history_save(led_state_object_t *s, const struct smf_state *target){
+    const struct smf_state *leaf = smf_get_current_leaf_state(SMF_CTX(s));
+    for (const struct smf_state *parent = leaf->parent; parent; parent = parent->parent) {
+        if (!state_within(target, parent)) {
+            s->history[parent - led_states] = leaf;
+        }
+    }
+}
 
-    LED_set(LED0, LED_OFF);   // LED1
-    LED_set(LED2, LED_OFF);   // LED3
-    LED_set(LED1, LED_OFF);  // LED2
-    LED_set(LED3, LED_OFF);  // LED4
-    
-     ascii_clear();
-    
+static const struct smf_state *history_target(led_state_object_t *s, const led_sm_transition *t){
+    const struct smf_state *target = &led_states[t->target];
+    if (t->history == LED_SM_HISTORY_NONE) {
+        return target;
+    }
+
+    // Never left yet → the composite itself, its initial transition picks the child
+    const struct smf_state *state = s->history[t->target];
+    if (t->history == LED_SM_HISTORY_SHALLOW) {
+        while (state != target && state->parent != target) {
+            state = state->parent;
+        }
+    }
+    return state;
 }
-static enum smf_state_result state0_run(void *o){ // S0 behavior
-     led_state_object_t *s = o;
 
-    if (b0()&&b1()){
-        led_state_object.previous_state = State_0;
-	    smf_set_state(SMF_CTX(s), &led_states[State_3]);
-        printk("Blinking standby mode.");
-        return SMF_EVENT_HANDLED;
+/* ---------- stats ---------- */
+#ifdef CONFIG_APP_SM_STATS
+// One group per state, registered as its diagram name. Composite states count their children's time too
+STATS_SECT_START(sm_state_stats)
+STATS_SECT_ENTRY32(entries)
+STATS_SECT_ENTRY32(residency_ms)   // up to the last event dispatched
+STATS_SECT_ENTRY32(run_max_us)     // worst run of this state alone, action and transition included
+STATS_SECT_ENTRY32(events)         // events this state handled itself
+STATS_SECT_ENTRY32(events_per_s)   // events over residency
+STATS_SECT_END;
+
+STATS_NAME_START(sm_state_stats)
+STATS_NAME(sm_state_stats, entries)
+STATS_NAME(sm_state_stats, residency_ms)
+STATS_NAME(sm_state_stats, run_max_us)
+STATS_NAME(sm_state_stats, events)
+STATS_NAME(sm_state_stats, events_per_s)
+STATS_NAME_END(sm_state_stats);
+
+static STATS_SECT_DECL(sm_state_stats) state_stats[LED_SM_NUM_STATES];
+static uint32_t stats_since_ms;   // uptime the residency was last added up to
+
+static void stats_register(void){
+    for (int i = 0; i < LED_SM_NUM_STATES; i++) {
+        stats_init_and_reg(STATS_HDR(state_stats[i]), STATS_SIZE_INIT_PARMS(state_stats[i], STATS_SIZE_32),
+                           STATS_NAME_INIT_PARMS(sm_state_stats), led_sm_state_names[i]);
     }
+    stats_since_ms = k_uptime_get_32();
+}
+
+static inline uint32_t stats_clock(void){
+    return k_cycle_get_32();
+}
 
-    // BTN0 → add a 0 bit
-    if (b0()) {
-		    printk("Input as 0.\n");
-        ascii_add_bit(0);
+static void stats_run(enum led_sm_state state, uint32_t start, bool handled){
+    uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    if (us > STATS_GET(state_stats[state], run_max_us)) {
+        STATS_SET(state_stats[state], run_max_us, us);
     }
+    if (handled) {
+        STATS_INC(state_stats[state], events);
+    }
+}
 
-    // BTN1 → add a 1 bit
-    if (b1()) {
-		    printk("Input as 1.\n");
-        ascii_add_bit(1);
+// Adds the time since the last call to the leaf that was active and its parents, counts the states entered
+static void stats_account(const struct smf_state *from, const struct smf_state *to){
+    uint32_t now = k_uptime_get_32();
+    for (const struct smf_state *state = from; state; state = state->parent) {
+        STATS_SECT_DECL(sm_state_stats) *st = &state_stats[state - led_states];
+        STATS_INCN(*st, residency_ms, now - stats_since_ms);
+        STATS_SET(*st, events_per_s,
+                  (uint64_t)STATS_GET(*st, events) * MSEC_PER_SEC / MAX(STATS_GET(*st, residency_ms), 1));
     }
+    stats_since_ms = now;
 
-    // BTN2 → clear current ASCII, stay in State_0
-    if (b2()) {
-        ascii_clear();
-        printk("Cleared the ASCII code you made.\n");
-        return SMF_EVENT_HANDLED;
+    for (const struct smf_state *state = to; state && !state_within(from, state); state = state->parent) {
+        STATS_INC(state_stats[state - led_states], entries);
     }
+}
+#else
+static inline void stats_register(void){
+}
+
+static inline uint32_t stats_clock(void){
+    return 0;
+}
+
+static inline void stats_run(enum led_sm_state state, uint32_t start, bool handled){
+    ARG_UNUSED(state);
+    ARG_UNUSED(start);
+    ARG_UNUSED(handled);
+}
+
+static inline void stats_account(const struct smf_state *from, const struct smf_state *to){
+    ARG_UNUSED(from);
+    ARG_UNUSED(to);
+}
+#endif
 
-    // BTN3 → finished ASCII, go to State_1
-    if (b3()) {
-		    ascii_save_code();
-		    printk("Saved char: %c   Full buffer: %s\n", ascii_string[ascii_string_len-1], ascii_string);
-        smf_set_state(SMF_CTX(s), &led_states[State_1]);
+// One table lookup, unhandled events go to the parent
+static enum smf_state_result dispatch(void *o, enum led_sm_state state){
+    led_state_object_t *s = o;
+    if (current_event == LED_SM_NUM_EVENTS) {
         return SMF_EVENT_HANDLED;
     }
-    
-    // Blink LED3 (or LED2 depending on mapping) at 1 Hz
-    if (++s->count >= TOGGLE1_MS) {
-        s->count = 0;
-        s->phase = !s->phase;
-        LED_set(LED2, s->phase ? LED_ON : LED_OFF);
+
+    const led_sm_transition *t = &led_transitions[state][current_event];
+    if (!t->handled) {
+        return SMF_EVENT_PROPAGATE;
     }
 
+    if (t->action) {
+        t->action(o);
+    }
+    if (t->target != LED_SM_NO_TARGET) {
+        history_save(s, &led_states[t->target]);
+        smf_set_state(SMF_CTX(s), history_target(s, t));
+    }
     return SMF_EVENT_HANDLED;
 }
 
-static void state0_exit(void *o)
-{
-    (void)o;
-    /* no teardown required */
+// Run of every state
+static enum smf_state_result led_sm_dispatch(void *o, enum led_sm_state state){
+    uint32_t start = stats_clock();
+    enum smf_state_result result = dispatch(o, state);
+    stats_run(state, start, result == SMF_EVENT_HANDLED && current_event != LED_SM_NUM_EVENTS);
+    return result;
 }
 
-/* ================= State_1: ================= */
-static void state1_entry(void* o)
-{
-    led_state_object_t *s = o;
-    s->count = 0;
-    s->phase = false;
-
-    LED_set(LED0, LED_OFF);   // LED1
-    LED_set(LED2, LED_OFF);   // LED3
-    LED_set(LED1, LED_OFF);  // LED2
-    LED_set(LED3, LED_OFF);  // LED4
-        
+/* ---------- API ---------- */
+void state_machine_init(){
+    static const btn_gesture_config bit_gestures = {
+        .repeat_delay_ms = BIT_REPEAT_DELAY_MS,
+        .repeat_interval_ms = BIT_REPEAT_INTERVAL_MS,
+    };
+    static const btn_gesture_config clear_gestures = {
+        .long_press_ms = CLEAR_ALL_HOLD_MS,
+    };
+
+    BTN_chord_config(STANDBY_CHORD, CHORD_WINDOW_MS);
+    BTN_gesture_config(BTN0, &bit_gestures);
+    BTN_gesture_config(BTN1, &bit_gestures);
+    BTN_gesture_config(BTN2, &clear_gestures);
+    ascii_buffer_listen(&console_listener);
+    for (int i = 0; i < LED_SM_NUM_STATES; i++) {
+        led_state_object.history[i] = &led_states[i];
+    }
+    stats_register();
+    smf_set_initial(SMF_CTX(&led_state_object), &led_states[LED_SM_INITIAL]);
+    trace_record(NULL, smf_get_current_leaf_state(SMF_CTX(&led_state_object)), LED_SM_NUM_EVENTS);
+    stats_account(NULL, smf_get_current_leaf_state(SMF_CTX(&led_state_object)));
+}
+int state_machine_run(const btn_event *evt){
+    const struct smf_state *from = smf_get_current_leaf_state(SMF_CTX(&led_state_object));
+    current_event = event_of(evt);
+    int ret = smf_run_state(SMF_CTX(&led_state_object));
+
+    const struct smf_state *to = smf_get_current_leaf_state(SMF_CTX(&led_state_object));
+    if (to != from) {
+        trace_record(from, to, current_event);
+        notify_listeners(from, to, current_event);
+    }
+    stats_account(from, to);
+    current_event = LED_SM_NUM_EVENTS;
+    return ret;
+}
+// Listeners registered after init only hear about later changes
+void state_machine_listen(sm_listener *listener){
+    sys_slist_append(&sm_listeners, &listener->node);
+}
+// Of the current leaf state, listeners calling it get the state just entered
+sm_activity state_machine_activity(){
+    const struct smf_state *leaf = smf_get_current_leaf_state(SMF_CTX(&led_state_object));
+    if (state_within(leaf, &led_states[State_Entry])) {
+        return SM_ACTIVITY_ENTRY;
+    } else if (state_within(leaf, &led_states[State_3])) {
+        return SM_ACTIVITY_STANDBY;
+    }
+    return SM_ACTIVITY_IDLE;
 }
 
-static enum smf_state_result state1_run(void *o){ // S1 behavior
-   led_state_object_t *s = o;
-     
-   if (b2()) {
-        ascii_clear();
-        ascii_string_clear();
-        printk("You have chosen to clear your entire string.\n");
-        smf_set_state(SMF_CTX(s), &led_states[State_0]);
-        return SMF_EVENT_HANDLED;
+#ifdef CONFIG_APP_SM_TRACE
+// Copies out the newest records, oldest first. Safe from any thread, returns how many were copied
+int state_machine_trace_read(sm_trace_record *records, int max){
+    if (!records || max <= 0) {
+        return 0;
     }
-    
-    if (b0()&&b1()){
-        led_state_object.previous_state = State_1;
-	    smf_set_state(SMF_CTX(s), &led_states[State_3]);
-        printk("Blinking standby mode.");
-        return SMF_EVENT_HANDLED;
+    uint32_t head = atomic_get(&trace_head);
+    int count = MIN(MIN(head, (uint32_t)CONFIG_APP_SM_TRACE_SIZE), (uint32_t)max);
+    uint32_t first = head - count;
+    for (int i = 0; i < count; i++) {
+        records[i] = trace_ring[(first + i) & TRACE_MASK];
     }
-        // BTN0 → add a 0 bit
-    if (b0()) {
-		    printk("Input as 0.\n");
-        ascii_add_bit(0);
+
+    // Records the writer lapped while they were copied may be torn, drop them
+    int32_t lapped = (int32_t)(atomic_get(&trace_head) - CONFIG_APP_SM_TRACE_SIZE + 1 - first);
+    if (lapped > 0) {
+        lapped = MIN(lapped, count);
+        count -= lapped;
+        memmove(records, &records[lapped], count * sizeof(*records));
     }
+    return count;
+}
 
-    // BTN1 → add a 1 bit
-    if (b1()) {
-		    printk("Input as 1.\n");
-        ascii_add_bit(1);
+#ifdef CONFIG_SHELL
+static int cmd_sm_trace(const struct shell *sh, size_t argc, char **argv){
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+    static sm_trace_record records[CONFIG_APP_SM_TRACE_SIZE];   // too big for the shell stack
+    uint32_t held_ms[LED_SM_NUM_STATES] = {0};
+
+    int count = state_machine_trace_read(records, ARRAY_SIZE(records));
+    uint32_t now = k_cycle_get_32();
+    for (int i = 0; i < count; i++) {
+        const sm_trace_record *r = &records[i];
+        // Held until the next transition, or still held for the newest one
+        uint32_t until = (i + 1 < count) ? records[i + 1].timestamp : now;
+        uint32_t ms = k_cyc_to_ms_floor32(until - r->timestamp);
+        held_ms[r->to] += ms;
+        shell_print(sh, "%10u  %-12s -> %-12s  %-14s  held %u ms", r->timestamp,
+                    r->from < LED_SM_NUM_STATES ? led_sm_state_names[r->from] : "[*]",
+                    led_sm_state_names[r->to],
+                    r->event < LED_SM_NUM_EVENTS ? led_sm_event_names[r->event] : "-",
+                    ms);
     }
-    
-    // BTN3 → finished ASCII, go to State_2
-    if (b3()) {
-		    ascii_save_code();
-		    printk("Saved char: %c   Full buffer: %s\n", ascii_string[ascii_string_len-1], ascii_string);
-        smf_set_state(SMF_CTX(s), &led_states[State_2]);
-        return SMF_EVENT_HANDLED;
+
+    shell_print(sh, "Time held over the trace:");
+    for (int i = 0; i < LED_SM_NUM_STATES; i++) {
+        if (held_ms[i]) {
+            shell_print(sh, "  %-12s %u ms", led_sm_state_names[i], held_ms[i]);
+        }
     }
-    
-     if (++s->count >= TOGGLE4_MS) {
-      s->count = 0;
-      s->phase = !s->phase;
-      LED_set(LED2, s->phase ? LED_ON : LED_OFF);
+    return 0;
+}
+
+SHELL_SUBCMD_ADD((sm), trace, NULL, "Dump the transition trace, oldest first", cmd_sm_trace, 1, 0);
+#endif
+#endif
+
+#if defined(CONFIG_APP_SM_STATS) && defined(CONFIG_SHELL)
+static int cmd_sm_stats(const struct shell *sh, size_t argc, char **argv){
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+    shell_print(sh, "%-12s %8s %12s %10s %8s %8s", "state", "entries", "residency ms", "run max us", "events", "ev/s");
+    for (int i = 0; i < LED_SM_NUM_STATES; i++) {
+        shell_print(sh, "%-12s %8u %12u %10u %8u %8u", led_sm_state_names[i],
+                    STATS_GET(state_stats[i], entries), STATS_GET(state_stats[i], residency_ms),
+                    STATS_GET(state_stats[i], run_max_us), STATS_GET(state_stats[i], events),
+                    STATS_GET(state_stats[i], events_per_s));
     }
-      return SMF_EVENT_HANDLED;
- }
- 
- static void state1_exit(void *o)
+    return 0;
+}
+
+SHELL_SUBCMD_ADD((sm), stats, NULL, "Per state entries, residency, worst run time and event rate", cmd_sm_stats, 1, 0);
+#endif
+
+#if defined(CONFIG_SHELL) && (defined(CONFIG_APP_SM_TRACE) || defined(CONFIG_APP_SM_STATS))
+SHELL_SUBCMD_SET_CREATE(sub_sm, (sm));
+SHELL_CMD_REGISTER(sm, &sub_sm, "State machine commands", NULL);
+#endif
+
+
+/* ================= actions ================= */
+static void add_bit_0(void *o)
 {
     (void)o;
-    /* no teardown required */
+    printk("Input as 0.\n");
+    ascii_add_bit(0);
 }
 
-/* ================= State_2: ================= */
-static void state2_entry(void* o)
+static void add_bit_1(void *o)
 {
-    led_state_object_t *s = o;
-    s->count = 0;
-    s->phase = false;
-
-    LED_set(LED0, LED_OFF);   // LED1
-    LED_set(LED2, LED_OFF);   // LED3
-    LED_set(LED1, LED_OFF);  // LED2
-    LED_set(LED3, LED_OFF);  // LED4
-        
+    (void)o;
+    printk("Input as 1.\n");
+    ascii_add_bit(1);
 }
 
-static enum smf_state_result state2_run(void *o){ // S2 behavior
+static void clear_code(void *o)
+{
+    (void)o;
+    ascii_clear();
+    printk("Cleared the ASCII code you made.\n");
+}
 
-	led_state_object_t *s = o;
+static void clear_string(void *o)
+{
+    (void)o;
+    ascii_string_clear();
+    printk("You have chosen to clear your entire string.\n");
+}
 
-	if (b0()&&b1()){
-        led_state_object.previous_state = State_2;
-	    smf_set_state(SMF_CTX(s), &led_states[State_3]);
-        printk("Blinking standby mode.");
-        return SMF_EVENT_HANDLED;
-    }
-   
-    if (b2()) {
-        ascii_clear();
-        ascii_string_clear();
-        printk("You have chosen to clear your entire string.\n");
-        smf_set_state(SMF_CTX(s), &led_states[State_0]);
-        return SMF_EVENT_HANDLED;
-    }
+static void clear_all(void *o)
+{
+    (void)o;
+    ascii_clear();
+    ascii_string_clear();
+    printk("You have chosen to clear your entire string.\n");
+}
 
-    if (b3()) {
-    printk("Final string: %s\n", ascii_string);
-    // stay in State_2 or go back to State_0 depending on how they expect it
-    // For example:
-    smf_set_state(SMF_CTX(s), &led_states[State_0]);
-    return SMF_EVENT_HANDLED;
-    }
+static void save_code(void *o)
+{
+    (void)o;
+    ascii_save_code();
+}
 
-    if (++s->count >= TOGGLE16_MS) {
-        s->count = 0;
-        s->phase = !s->phase;
-        LED_set(LED2, s->phase ? LED_ON : LED_OFF);
+static void print_string(void *o)
+{
+    (void)o;
+    // Streamed in chunks, the buffer can be far bigger than any stack copy
+    char chunk[32];
+    int len;
+    printk("Final string (%u characters, %u lost): ", (unsigned int)ascii_buffer_len(), ascii_buffer_lost());
+    for (size_t offset = 0; (len = ascii_buffer_read(offset, chunk, sizeof(chunk))) > 0; offset += len) {
+        printk("%.*s", len, chunk);
     }
+    printk("\n");
+}
 
-    return SMF_EVENT_HANDLED;
-  
-	
+static void enter_standby(void *o)
+{
+    (void)o;
+    printk("Blinking standby mode.");
 }
 
- static void state2_exit(void *o)
+/* ================= State_0: ================= */
+static void state0_entry(void* o)
 {
     (void)o;
-    /* no teardown required */
+
+    leds_show(ALL_LEDS, 0);   // LED1 - LED4 off together
+
+    leds_check(LED_blink(LED2, LED_1HZ), LED2);   // LED3 blinks at 1 Hz, driven by the LED driver
+    
+     ascii_clear();
+    
 }
 
-/* ================= State_3: ================= */
-static void state3_entry(void* o)
+/* ================= State_1: ================= */
+static void state1_entry(void* o)
 {
-    led_state_object_t *s = o;
-    s->count = 0;
-    s->phase = false;
+    (void)o;
+
+    leds_show(ALL_LEDS, 0);   // LED1 - LED4 off together
 
-    LED_set(LED0, LED_OFF);   // LED1
-    LED_set(LED2, LED_OFF);   // LED3
-    LED_set(LED1, LED_OFF);  // LED2
-    LED_set(LED3, LED_OFF);  // LED4
+    leds_check(LED_blink(LED2, LED_4HZ), LED2);   // LED3 blinks at 4 Hz
         
 }
 
-static enum smf_state_result state3_run(void *o){ // S3 behavior
-
-	led_state_object_t *s = o;
-    // If any button clicked → exit standby and return to previous state
-    if (b0() || b1() || b2() || b3()) {
-        smf_set_state(SMF_CTX(o), &led_states[led_state_object.previous_state]);
-        return SMF_EVENT_HANDLED;
-    }
+/* ================= State_2: ================= */
+static void state2_entry(void* o)
+{
+    (void)o;
 
-    // Pulse all LEDs
-    pulse_all_leds();
+    leds_show(ALL_LEDS, 0);   // LED1 - LED4 off together
 
-    return SMF_EVENT_HANDLED;
+    leds_check(LED_blink(LED2, LED_16HZ), LED2);  // LED3 blinks at 16 Hz
+        
 }
 
-static void state3_exit(void *o)
+/* ================= State_3: ================= */
+static void state3_entry(void* o)
 {
     (void)o;
-    /* no teardown required */
+
+    leds_show(ALL_LEDS, 0);   // LED1 - LED4 off together
+
+    // The LED driver plays the breath on its own, nothing to wake up for
+    leds_check(LED_breathe(LED0, PULSE_MIN, PULSE_MAX, PULSE_PERIOD_MS, LED_CURVE_LINEAR), LED0);
+    leds_check(LED_breathe(LED1, PULSE_MIN, PULSE_MAX, PULSE_PERIOD_MS, LED_CURVE_LINEAR), LED1);
+    leds_check(LED_breathe(LED2, PULSE_MIN, PULSE_MAX, PULSE_PERIOD_MS, LED_CURVE_LINEAR), LED2);
+    leds_check(LED_breathe(LED3, PULSE_MIN, PULSE_MAX, PULSE_PERIOD_MS, LED_CURVE_LINEAR), LED3);
 }
@@ -5,7 +5,41 @@
 #ifndef MY_STATE_MACHINE_H
 #define MY_STATE_MACHINE_H
 
+#include <zephyr/kernel.h>
+#include <zephyr/sys/slist.h>
+
+#include "BTN.h"
+
 void state_machine_init();
-int state_machine_run();
+int state_machine_run(const btn_event *evt);
+
+// Told about every state change, from the state machine thread
+typedef struct sm_listener {
+    sys_snode_t node;
+    void (*changed)(uint8_t from, uint8_t to, uint8_t event, void *user_data);   // same encoding as the trace
+    void *user_data;
+} sm_listener;
+
+void state_machine_listen(sm_listener *listener);
+
+// What the user is doing, for code that shouldn't know the diagram's states
+typedef enum {
+    SM_ACTIVITY_ENTRY = 0,   // entering bits (State_0, State_1)
+    SM_ACTIVITY_IDLE,        // awake, not entering bits
+    SM_ACTIVITY_STANDBY,     // State_3
+} sm_activity;
+
+sm_activity state_machine_activity(void);
+
+#ifdef CONFIG_APP_SM_TRACE
+typedef struct sm_trace_record_t {
+    uint32_t timestamp;   // k_cycle_get_32() right after the transition
+    uint8_t from;         // leaf state left, LED_SM_NUM_STATES for the initial state
+    uint8_t to;           // leaf state entered
+    uint8_t event;        // event that caused it, LED_SM_NUM_EVENTS for none
+} sm_trace_record;
+
+int state_machine_trace_read(sm_trace_record *records, int max);
+#endif
 
 #endif //MY_STATE_MACHINE_H
\ No newline at end of file
@@ -0,0 +1,189 @@
+/*
+ * remote_input.c
+ *
+ * Virtual button events from BLE or the shell. They queue here with the time they are due
+ * and a work item hands each one to BTN_inject() when it is, waiting for room in the button
+ * event queue after that, so a burst never overflows it and the state machine sees them
+ * exactly like presses of the real buttons. Gestures and chords are timed from the moment an
+ * event is injected, so spacing events out is what reproduces them.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include "remote_input.h"
+
+#define RETRY_MS    1   // wait for the state machine to drain the button event queue
+
+typedef struct {
+    int64_t due;   // uptime ticks
+    uint8_t btn;
+    bool pressed;
+} remote_input_event;
+
+K_MSGQ_DEFINE(remote_input_queue, sizeof(remote_input_event), CONFIG_APP_REMOTE_INPUT_QUEUE_SIZE, 4);
+static atomic_t dropped = ATOMIC_INIT(0);
+static struct k_spinlock lock;   // free room is shared between posters and reservations
+static uint32_t reserved = 0;    // room promised by remote_input_reserve() and not posted yet
+
+static void feed(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(feed_work, feed);
+
+static void feed(struct k_work *work)
+{
+    remote_input_event evt;
+
+    while (0 == k_msgq_peek(&remote_input_queue, &evt)) {
+        if (evt.due > k_uptime_ticks()) {
+            k_work_reschedule(&feed_work, K_TIMEOUT_ABS_TICKS(evt.due));
+            return;
+        }
+        int err = BTN_inject(evt.btn, evt.pressed, k_cycle_get_32());
+        if (err == -EAGAIN) {
+            k_work_schedule(&feed_work, K_MSEC(RETRY_MS));
+            return;
+        } else if (err == -EBUSY) {
+            atomic_inc(&dropped);   // the real button is in use, it wins
+        }
+        k_msgq_get(&remote_input_queue, &evt, K_NO_WAIT);
+    }
+}
+
+// Queues one event in room nobody reserved
+static int put_unreserved(const remote_input_event *evt)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    int err = k_msgq_num_free_get(&remote_input_queue) > reserved ?
+              k_msgq_put(&remote_input_queue, evt, K_NO_WAIT) : -ENOMSG;
+    k_spin_unlock(&lock, key);
+    if (err) {
+        return -ENOSPC;
+    }
+    k_work_schedule(&feed_work, K_NO_WAIT);
+    return 0;
+}
+
+/**
+ * @brief Queues one virtual press or release. Safe from any thread, never blocks. Events are
+ *        injected in the order they are queued, one due earlier than the event ahead of it
+ *        waits for that one
+ *
+ * @param [in] due Uptime ticks to inject the event at, anything in the past goes right away
+ *
+ * @return 0 on success, -EINVAL on an invalid button, -ENOSPC if the queue is full
+ */
+int remote_input_post(btn_id btn, bool pressed, int64_t due)
+{
+    if (btn >= NUM_BTNS) {
+        return -EINVAL;
+    }
+    remote_input_event evt = {.due = due, .btn = btn, .pressed = pressed};
+    if (0 != put_unreserved(&evt)) {
+        atomic_inc(&dropped);
+        return -ENOSPC;
+    }
+    return 0;
+}
+
+/**
+ * @brief Sets room aside for a burst that has to be queued whole or not at all. Post each
+ *        of its events with remote_input_post_reserved() right after. Never blocks
+ *
+ * @param [in] count Events in the burst
+ *
+ * @return 0 on success, -ENOSPC if the queue can't take all of them, they count as dropped
+ */
+int remote_input_reserve(uint32_t count)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    bool room = k_msgq_num_free_get(&remote_input_queue) - reserved >= count;
+    if (room) {
+        reserved += count;
+    }
+    k_spin_unlock(&lock, key);
+
+    if (!room) {
+        atomic_add(&dropped, count);
+        return -ENOSPC;
+    }
+    return 0;
+}
+
+/**
+ * @brief Queues one event of a burst into the room remote_input_reserve() set aside, so it
+ *        can't find the queue full. Like remote_input_post() otherwise
+ *
+ * @return 0 on success, -EINVAL on an invalid button, its room is given back
+ */
+int remote_input_post_reserved(btn_id btn, bool pressed, int64_t due)
+{
+    remote_input_event evt = {.due = due, .btn = btn, .pressed = pressed};
+
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    reserved--;
+    if (btn < NUM_BTNS) {
+        k_msgq_put(&remote_input_queue, &evt, K_NO_WAIT);
+    }
+    k_spin_unlock(&lock, key);
+
+    if (btn >= NUM_BTNS) {
+        return -EINVAL;
+    }
+    k_work_schedule(&feed_work, K_NO_WAIT);
+    return 0;
+}
+
+// Events refused because the queue was full or the real button was in use
+uint32_t remote_input_dropped(void)
+{
+    return (uint32_t)atomic_get(&dropped);
+}
+
+#ifdef CONFIG_SHELL
+// Shell thread only, waits for room instead of dropping so a burst goes through whole
+static void post_waiting(btn_id btn, bool pressed)
+{
+    remote_input_event evt = {.due = 0, .btn = btn, .pressed = pressed};
+    while (0 != put_unreserved(&evt)) {
+        k_msleep(RETRY_MS);
+    }
+}
+
+static int cmd_btn_inject(const struct shell *sh, size_t argc, char **argv)
+{
+    long btn = strtol(argv[1], NULL, 0);
+    uint32_t count = argc > 3 ? strtoul(argv[3], NULL, 0) : 1;
+    bool press = 0 == strcmp(argv[2], "press");
+    bool release = 0 == strcmp(argv[2], "release");
+
+    if (btn < 0 || btn >= NUM_BTNS) {
+        shell_error(sh, "Button %ld doesn't exist, there are %d", btn, NUM_BTNS);
+        return -EINVAL;
+    } else if (!press && !release && 0 != strcmp(argv[2], "click")) {
+        shell_error(sh, "Expected press, release or click, got %s", argv[2]);
+        return -EINVAL;
+    }
+
+    uint32_t start = k_uptime_get_32();
+    for (uint32_t i = 0; i < count; i++) {
+        if (!release) {
+            post_waiting(btn, true);
+        }
+        if (!press) {
+            post_waiting(btn, false);
+        }
+    }
+    shell_print(sh, "Queued %u x %s on BTN%ld in %u ms, %u dropped since boot", count, argv[2], btn,
+                k_uptime_get_32() - start, remote_input_dropped());
+    return 0;
+}
+
+// Joins the "btn" command set of btn_shell.c
+SHELL_SUBCMD_ADD((btn), inject, NULL, "<btn> <press|release|click> [count]  Virtual button events",
+                 cmd_btn_inject, 3, 1);
+#endif
@@ -0,0 +1,17 @@
+/**
+ * @file remote_input.h
+ */
+
+#ifndef REMOTE_INPUT_H
+#define REMOTE_INPUT_H
+
+#include <zephyr/kernel.h>
+
+#include "BTN.h"
+
+int remote_input_post(btn_id btn, bool pressed, int64_t due);
+int remote_input_reserve(uint32_t count);
+int remote_input_post_reserved(btn_id btn, bool pressed, int64_t due);
+uint32_t remote_input_dropped(void);
+
+#endif //REMOTE_INPUT_H
@@ -6,18 +6,76 @@ Header to define button interface
 #define BTN_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+
+/* ----------------------------------------------------------------------------
+                                    Constants
+---------------------------------------------------------------------------- */
+#define BTN_NODE              DT_COMPAT_GET_ANY_STATUS_OKAY(gpio_keys)
+
+// One button per enabled child of the gpio-keys node, in devicetree order
+#define NUM_BTNS              DT_CHILD_NUM_STATUS_OKAY(BTN_NODE)
+
+// Every button, for masks and chords
+#define BTN_MASK_ALL          (UINT32_MAX >> (32 - NUM_BTNS))
 
 /* ----------------------------------------------------------------------------
                                     TYPES
 ---------------------------------------------------------------------------- */
+// Names for the first buttons, boards with more pass the plain index
 typedef enum btn_id_t {
   BTN0 = 0,
   BTN1,
   BTN2,
   BTN3,
-  NUM_BTNS,
 } btn_id;
 
+typedef enum btn_event_type_t {
+  BTN_EVENT_PRESS = 0,
+  BTN_EVENT_RELEASE,
+  BTN_EVENT_CHORD, // Every button in the chord mask went down inside the coincidence window
+  BTN_EVENT_CLICK, // Pressed and released without a hold gesture or a second press
+  BTN_EVENT_DOUBLE_CLICK, // Second press followed the first release inside the double click window
+  BTN_EVENT_LONG_PRESS, // Held for the long press time
+  BTN_EVENT_REPEAT, // Auto-repeat while held
+} btn_event_type;
+
+typedef struct btn_event_t {
+  btn_id btn; // Lowest button in mask for chords
+  btn_event_type type;
+  uint32_t mask; // Buttons involved, BIT(btn) for single button events
+  uint32_t timestamp; // k_cycle_get_32() at the first edge of the debounced transition
+} btn_event;
+
+// Gesture timing for one button, a 0 time turns that gesture off
+typedef struct btn_gesture_config_t {
+  uint16_t double_click_ms; // Clicks are delayed by this long waiting for a second press
+  uint16_t long_press_ms;
+  uint16_t repeat_delay_ms;
+  uint16_t repeat_interval_ms;
+} btn_gesture_config;
+
+// Time from the first edge of a press to it being reported by the debounce backend
+typedef struct btn_latency_t {
+  uint32_t count; // Presses measured
+  uint32_t last_us;
+  uint32_t max_us;
+  uint64_t total_us; // Divide by count for the mean
+} btn_latency;
+
+// Called for every button event once BTN_callback_set() registered it. evt points into the driver's
+// event ring and is only valid during the call
+typedef void (*btn_callback)(const btn_event *evt, void *user_data);
+
+#define BTN_GESTURE_CONFIG_DEFAULT {                  \
+  .double_click_ms=CONFIG_BTN_DOUBLE_CLICK_MS,        \
+  .long_press_ms=CONFIG_BTN_LONG_PRESS_MS,            \
+  .repeat_delay_ms=CONFIG_BTN_REPEAT_DELAY_MS,        \
+  .repeat_interval_ms=CONFIG_BTN_REPEAT_INTERVAL_MS,  \
+}
+
 /* ----------------------------------------------------------------------------
                               Public Functions
 ---------------------------------------------------------------------------- */
@@ -25,10 +83,28 @@ int BTN_init();
 
 bool BTN_is_pressed(btn_id btn);
 
+uint32_t BTN_get_mask();
+
 bool BTN_check_clear_pressed(btn_id btn);
 
 bool BTN_check_pressed(btn_id btn);
 
 void BTN_clear_pressed(btn_id btn);
 
+int BTN_event_get(btn_event *evt, k_timeout_t timeout);
+
+uint32_t BTN_event_overflows();
+
+void BTN_callback_set(btn_callback cb, void *user_data);
+
+int BTN_chord_config(uint32_t mask, uint32_t window_ms);
+
+int BTN_gesture_config(btn_id btn, const btn_gesture_config *config);
+
+void BTN_latency_get(btn_latency *stats);
+
+#ifdef CONFIG_BTN_INJECT
+int BTN_inject(btn_id btn, bool pressed, uint32_t timestamp);
+#endif
+
 #endif
\ No newline at end of file
@@ -6,6 +6,9 @@ Header to define button module logic
 #include <zephyr/device.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/sys/printk.h>
+#ifdef CONFIG_BTN_DEBOUNCE_INPUT
+#include <zephyr/input/input.h>
+#endif
 #include <inttypes.h>
 
 #include "BTN.h"
@@ -13,45 +16,149 @@ Header to define button module logic
 /* ----------------------------------------------------------------------------
                                     Constants
 ---------------------------------------------------------------------------- */
-#define BTN_DEBOUNCE_MS   20
+#ifdef CONFIG_BTN_DEBOUNCE_SAMPLED
+#define BTN_STABLE_MASK   (UINT32_MAX >> (32 - CONFIG_BTN_STABLE_SAMPLES))
+#endif
 
 /* ----------------------------------------------------------------------------
                                   Macro Helpers
 ---------------------------------------------------------------------------- */
-#define BTN0_NODE             DT_ALIAS(sw0)
-#define BTN1_NODE             DT_ALIAS(sw1)
-#define BTN2_NODE             DT_ALIAS(sw2)
-#define BTN3_NODE             DT_ALIAS(sw3)
+#define BTN_SPEC_INIT(node)   GPIO_DT_SPEC_GET(node, gpios)
+#define BTN_CODE_INIT(node)   DT_PROP(node, zephyr_code)
 
 #define IS_INVALID_BTN(btn)   (btn >= NUM_BTNS || btn < 0)
 
+BUILD_ASSERT(NUM_BTNS > 0 && NUM_BTNS <= 32, "Button masks are 32 bits, the gpio-keys node needs 1 - 32 children");
+
 /* ----------------------------------------------------------------------------
                                     Types
 ---------------------------------------------------------------------------- */
+typedef struct btn_gesture_t {
+  btn_gesture_config config;
+  bool enabled;
+  bool held; // Reported pressed, the work item times hold gestures
+  bool click_pending; // Released, the work item times the double click window
+  bool second_press; // Pressed again inside the double click window
+  bool hold_reported; // A long press or repeat fired, the release isn't a click
+  uint32_t press_ms; // Uptime of the press being timed
+  uint32_t release_ms; // Uptime of the release opening the double click window
+  uint32_t next_repeat_ms; // Hold time of the next repeat
+  uint32_t press_timestamp;
+  struct k_work_delayable work;
+} btn_gesture;
+
+typedef struct btn_port_t {
+  const struct device *dev;
+  gpio_port_pins_t pins; // Every button pin on this port
+  struct gpio_callback cb;
+} btn_port;
+
 typedef struct btn_gpio_t {
-  struct gpio_dt_spec spec; 
+  const struct gpio_dt_spec *spec; // Entry of the devicetree table in flash
+  btn_id id;
+  btn_port *port; // Group of the buttons sharing spec->port
   volatile bool pressed;
-  struct gpio_callback cb;
-  struct k_work_delayable work;
+  bool active; // Last debounced level
+  uint32_t edge_timestamp; // Cycle count of the first edge in the current bounce burst
+  uint32_t history; // Sampled levels, newest in bit 0 (sampled backend)
+  bool locked; // Ignoring edges until the lockout ends (lockout backend)
+  struct k_work_delayable work; // Debounce (work backend) or lockout end (lockout backend)
+  btn_gesture gesture;
 } btn_gpio;
 
+typedef struct btn_chord_t {
+  uint32_t mask; // Buttons that make up the chord, 0 when chord detection is off
+  uint32_t window_ms; // How close together the member presses have to be
+  uint32_t window_start_ms; // Uptime of the first pending press
+  uint32_t pending; // Members pressed inside the current window, not reported yet
+  uint32_t consumed; // Members of a reported chord that haven't been released yet
+  uint32_t timestamps[NUM_BTNS]; // Press timestamps of the pending members
+  struct k_work_delayable work;
+} btn_chord;
+
 /* ----------------------------------------------------------------------------
                             Private Function Prototypes
 ---------------------------------------------------------------------------- */
 static int _btn_config(btn_gpio *btn);
 
+static btn_port *_btn_port_get(const struct device *dev);
+
+static bool _btn_level(const btn_gpio *btn, gpio_port_value_t raw);
+
+#ifndef CONFIG_BTN_DEBOUNCE_INPUT
 static void _btn_interrupt_service_routine(const struct device *dev, struct gpio_callback *cb, uint32_t pins);
+#endif
 
+#if defined(CONFIG_BTN_DEBOUNCE_WORK)
 static void _btn_debounce(struct k_work *work);
+#elif defined(CONFIG_BTN_DEBOUNCE_SAMPLED)
+static void _btn_sample(struct k_timer *timer);
+#elif defined(CONFIG_BTN_DEBOUNCE_LOCKOUT)
+static void _btn_lockout_end(struct k_work *work);
+#elif defined(CONFIG_BTN_DEBOUNCE_INPUT)
+static void _btn_input(struct input_event *evt, void *user_data);
+#endif
+
+static void _btn_debounced(btn_gpio *btn, bool active, uint32_t timestamp);
+
+static void _btn_report(btn_gpio *btn, btn_event_type type, uint32_t timestamp);
+
+static void _btn_chord_flush();
+
+static void _btn_chord_timeout(struct k_work *work);
+
+static void _btn_event_post(btn_id btn, btn_event_type type, uint32_t mask, uint32_t timestamp);
+
+static uint32_t _btn_event_room();
+
+static void _btn_callback_deliver(struct k_work *work);
+
+static void _btn_gesture_track(btn_gpio *btn, btn_event_type type, uint32_t timestamp);
+
+static void _btn_gesture_timeout(struct k_work *work);
+
+static void _btn_gesture_step(btn_gpio *btn, btn_gesture *g);
 
 /* ----------------------------------------------------------------------------
                                 Global States
 ---------------------------------------------------------------------------- */
-static btn_gpio _btn0 = {.spec=GPIO_DT_SPEC_GET(BTN0_NODE, gpios), .pressed=false};
-static btn_gpio _btn1 = {.spec=GPIO_DT_SPEC_GET(BTN1_NODE, gpios), .pressed=false};
-static btn_gpio _btn2 = {.spec=GPIO_DT_SPEC_GET(BTN2_NODE, gpios), .pressed=false};
-static btn_gpio _btn3 = {.spec=GPIO_DT_SPEC_GET(BTN3_NODE, gpios), .pressed=false};
-static btn_gpio *_btns[NUM_BTNS] = {&_btn0, &_btn1, &_btn2, &_btn3};
+static const struct gpio_dt_spec _btn_specs[NUM_BTNS] = {
+  DT_FOREACH_CHILD_STATUS_OKAY_SEP(BTN_NODE, BTN_SPEC_INIT, (,))
+};
+static btn_gpio _btns[NUM_BTNS]; // Linked to _btn_specs by BTN_init
+
+static btn_port _btn_ports[NUM_BTNS]; // Worst case every button sits on its own port
+static uint8_t _btn_num_ports = 0;
+
+K_MSGQ_DEFINE(_btn_event_queue, sizeof(btn_event), CONFIG_BTN_EVENT_QUEUE_SIZE, 4);
+static atomic_t _btn_event_overflows = ATOMIC_INIT(0);
+
+// Events waiting for the registered callback, delivered in order by _btn_callback_work
+static btn_event _btn_callback_events[CONFIG_BTN_EVENT_QUEUE_SIZE];
+static uint32_t _btn_callback_head = 0; // Next slot to fill
+static uint32_t _btn_callback_tail = 0; // Next slot to deliver, stays put during its call
+static btn_callback _btn_callback = NULL;
+static void *_btn_callback_user_data = NULL;
+static K_WORK_DEFINE(_btn_callback_work, _btn_callback_deliver);
+
+static btn_chord _btn_chord = {.mask=0};
+static btn_latency _btn_latency = {.count=0};
+
+// Guards everything past the debounce stage, which runs in ISR, timer and workqueue context
+static struct k_spinlock _btn_lock;
+
+#ifdef CONFIG_BTN_DEBOUNCE_SAMPLED
+K_TIMER_DEFINE(_btn_sample_timer, _btn_sample, NULL);
+static atomic_t _btn_sampling = ATOMIC_INIT(0); // Buttons the sample timer is watching
+#endif
+
+#ifdef CONFIG_BTN_DEBOUNCE_INPUT
+// gpio-keys owns the pins and debounces them, its key codes map back to button ids
+static const uint16_t _btn_codes[NUM_BTNS] = {
+  DT_FOREACH_CHILD_STATUS_OKAY_SEP(BTN_NODE, BTN_CODE_INIT, (,))
+};
+INPUT_CALLBACK_DEFINE(DEVICE_DT_GET(BTN_NODE), _btn_input, NULL);
+#endif
 
 /* ----------------------------------------------------------------------------
                               Private Functions
@@ -64,38 +171,111 @@ static btn_gpio *_btns[NUM_BTNS] = {&_btn0, &_btn1, &_btn2, &_btn3};
  * @return Error code, < 0 on failures
  */
 static int _btn_config(btn_gpio *btn) {
-  if (!gpio_is_ready_dt(&btn->spec)) {
+  if (!gpio_is_ready_dt(btn->spec)) {
 		return -EIO;
-	} else if (0 > gpio_pin_configure_dt(&btn->spec, GPIO_INPUT)) {
+#ifndef CONFIG_BTN_DEBOUNCE_INPUT
+	} else if (0 > gpio_pin_configure_dt(btn->spec, GPIO_INPUT)) {
 		return -EIO;
-  } else if (0 > gpio_pin_interrupt_configure_dt(&btn->spec, GPIO_INT_EDGE_TO_ACTIVE)) {
+  } else if (0 > gpio_pin_interrupt_configure_dt(btn->spec, GPIO_INT_EDGE_BOTH)) {
 		return -EIO;
+#endif
   } else {
-    gpio_init_callback(&btn->cb, _btn_interrupt_service_routine, BIT(btn->spec.pin));
-    gpio_add_callback(btn->spec.port, &btn->cb);
+    btn->active = (0 < gpio_pin_get_dt(btn->spec));
+    btn->port = _btn_port_get(btn->spec->port);
+    btn->port->pins |= BIT(btn->spec->pin);
+#if defined(CONFIG_BTN_DEBOUNCE_WORK)
     k_work_init_delayable(&btn->work, _btn_debounce);
+#elif defined(CONFIG_BTN_DEBOUNCE_LOCKOUT)
+    k_work_init_delayable(&btn->work, _btn_lockout_end);
+#endif
+    k_work_init_delayable(&btn->gesture.work, _btn_gesture_timeout);
     return 0;
   }
 }
 
 /**
- * @brief Invoked as an interrupt when a button goes to the active state (high)
+ * @brief Finds the group for a GPIO port, creating it on first use
+ * 
+ * @param [in] dev The GPIO port
+ * 
+ * @return The port group
+ */
+static btn_port *_btn_port_get(const struct device *dev) {
+  for (uint8_t i = 0; i < _btn_num_ports; i++) {
+    if (_btn_ports[i].dev == dev) {
+      return &_btn_ports[i];
+    }
+  }
+  _btn_ports[_btn_num_ports].dev = dev;
+  _btn_ports[_btn_num_ports].pins = 0;
+  return &_btn_ports[_btn_num_ports++];
+}
+
+/**
+ * @brief Gets a button's logical level out of a raw port snapshot
+ * 
+ * @param [in] btn The button to check
+ * @param [in] raw Raw input levels of the button's port
+ * 
+ * @return true if the button is active
+ */
+static bool _btn_level(const btn_gpio *btn, gpio_port_value_t raw) {
+  bool high = (raw & BIT(btn->spec->pin)) != 0;
+  return (btn->spec->dt_flags & GPIO_ACTIVE_LOW) ? !high : high;
+}
+
+#ifndef CONFIG_BTN_DEBOUNCE_INPUT
+/**
+ * @brief Invoked as an interrupt when any button on a port changes state (either edge).
+ *        One callback is registered per port with the pins of every button on it
  * 
  * @param [in] dev The GPIO port that triggered the interrupt
  * @param [in] cb A pointer to the registered callback structure for this ISR
  * @param [in] pins A bitmask for all the GPIO pins that triggered this interrupt
  */
 static void _btn_interrupt_service_routine(const struct device *dev, struct gpio_callback *cb, uint32_t pins) {
-  for (uint8_t i = 0; i < NUM_BTNS; i++) {
-    if (pins & BIT(_btns[i]->spec.pin)) {
-      k_work_reschedule(&_btns[i]->work, K_MSEC(BTN_DEBOUNCE_MS));
+  uint32_t now = k_cycle_get_32();
+  btn_port *port = CONTAINER_OF(cb, btn_port, cb);
+  k_spinlock_key_t key = k_spin_lock(&_btn_lock);
+
+  for (int i = 0; i < NUM_BTNS; i++) {
+    btn_gpio *btn = &_btns[i];
+    if (btn->port != port || !(pins & BIT(btn->spec->pin))) {
+      continue;
+    }
+#if defined(CONFIG_BTN_DEBOUNCE_WORK)
+    // Timestamp the first edge only, later bounces just push the debounce out
+    if (!k_work_delayable_is_pending(&btn->work)) {
+      btn->edge_timestamp = now;
+    }
+    k_work_reschedule(&btn->work, K_MSEC(CONFIG_BTN_DEBOUNCE_MS));
+#elif defined(CONFIG_BTN_DEBOUNCE_SAMPLED)
+    atomic_val_t sampling = atomic_or(&_btn_sampling, BIT(i));
+    if (!(sampling & BIT(i))) {
+      btn->edge_timestamp = now;
+      btn->history = btn->active ? UINT32_MAX : 0;
     }
+    if (0 == sampling) {
+      k_timer_start(&_btn_sample_timer, K_MSEC(CONFIG_BTN_SAMPLE_PERIOD_MS), K_MSEC(CONFIG_BTN_SAMPLE_PERIOD_MS));
+    }
+#elif defined(CONFIG_BTN_DEBOUNCE_LOCKOUT)
+    // Both edges interrupt, so the first edge outside a lockout is always a change of state
+    if (!btn->locked) {
+      btn->locked = true;
+      k_work_reschedule(&btn->work, K_MSEC(CONFIG_BTN_DEBOUNCE_MS));
+      _btn_debounced(btn, !btn->active, now);
+    }
+#endif
   }
+
+  k_spin_unlock(&_btn_lock, key);
   return;
 }
+#endif
 
+#if defined(CONFIG_BTN_DEBOUNCE_WORK)
 /**
- * @brief Called once the button has been debounced, sets button pressed state
+ * @brief Called once the button has been debounced, queues a press/release event if the level changed
  * 
  * @param [in] work A k_work struct contained by a k_work_delayable inside a btn_gpio struct
  */
@@ -103,8 +283,393 @@ static void _btn_debounce(struct k_work *_work) {
   struct k_work_delayable *dwork = CONTAINER_OF(_work, struct k_work_delayable, work);
   btn_gpio *btn = CONTAINER_OF(dwork, btn_gpio, work);
 
-  if (gpio_pin_get_dt(&btn->spec)) {
-    btn->pressed = true;
+  k_spinlock_key_t key = k_spin_lock(&_btn_lock);
+  _btn_debounced(btn, 0 < gpio_pin_get_dt(btn->spec), btn->edge_timestamp);
+  k_spin_unlock(&_btn_lock, key);
+}
+#elif defined(CONFIG_BTN_DEBOUNCE_SAMPLED)
+/**
+ * @brief Shifts a new sample into every unstable button, reports the ones that have settled.
+ *        Stops itself once no button is left to watch
+ * 
+ * @param [in] timer The shared sampling timer
+ */
+static void _btn_sample(struct k_timer *timer) {
+  k_spinlock_key_t key = k_spin_lock(&_btn_lock);
+
+  // One snapshot per port, every button on it is sampled at the same instant
+  gpio_port_value_t raw[NUM_BTNS] = {0};
+  for (uint8_t i = 0; i < _btn_num_ports; i++) {
+    gpio_port_get_raw(_btn_ports[i].dev, &raw[i]);
+  }
+
+  atomic_val_t sampling = atomic_get(&_btn_sampling);
+  for (int i = 0; i < NUM_BTNS; i++) {
+    if (!(sampling & BIT(i))) {
+      continue;
+    }
+    btn_gpio *btn = &_btns[i];
+    btn->history = (btn->history << 1) | _btn_level(btn, raw[btn->port - _btn_ports]);
+
+    uint32_t window = btn->history & BTN_STABLE_MASK;
+    if (BTN_STABLE_MASK == window || 0 == window) {
+      atomic_and(&_btn_sampling, ~BIT(i));
+      _btn_debounced(btn, 0 != window, btn->edge_timestamp);
+    }
+  }
+
+  if (0 == atomic_get(&_btn_sampling)) {
+    k_timer_stop(timer);
+  }
+
+  k_spin_unlock(&_btn_lock, key);
+}
+#elif defined(CONFIG_BTN_DEBOUNCE_LOCKOUT)
+/**
+ * @brief Ends a button's lockout. If the level moved while edges were ignored the change is
+ *        reported now and a new lockout starts
+ * 
+ * @param [in] work A k_work struct contained by a k_work_delayable inside a btn_gpio struct
+ */
+static void _btn_lockout_end(struct k_work *_work) {
+  struct k_work_delayable *dwork = CONTAINER_OF(_work, struct k_work_delayable, work);
+  btn_gpio *btn = CONTAINER_OF(dwork, btn_gpio, work);
+
+  k_spinlock_key_t key = k_spin_lock(&_btn_lock);
+  bool active = (0 < gpio_pin_get_dt(btn->spec));
+  if (active != btn->active) {
+    k_work_reschedule(&btn->work, K_MSEC(CONFIG_BTN_DEBOUNCE_MS));
+    _btn_debounced(btn, active, k_cycle_get_32());
+  } else {
+    btn->locked = false;
+  }
+  k_spin_unlock(&_btn_lock, key);
+}
+#elif defined(CONFIG_BTN_DEBOUNCE_INPUT)
+/**
+ * @brief Input subsystem callback for the gpio-keys device. Its events are already debounced, so
+ *        they go straight to the common sink. gpio-keys doesn't pass the edge time on, the
+ *        timestamp is when the event got here
+ * 
+ * @param [in] evt The input event, only valid for the duration of the call
+ * @param [in] user_data Unused
+ */
+static void _btn_input(struct input_event *evt, void *user_data) {
+  if (INPUT_EV_KEY != evt->type) {
+    return;
+  }
+
+  for (int i = 0; i < NUM_BTNS; i++) {
+    if (_btn_codes[i] != evt->code) {
+      continue;
+    }
+    k_spinlock_key_t key = k_spin_lock(&_btn_lock);
+    if (NULL != _btns[i].spec) { // Dropped until BTN_init has run
+      _btn_debounced(&_btns[i], 0 != evt->value, k_cycle_get_32());
+    }
+    k_spin_unlock(&_btn_lock, key);
+    return;
+  }
+}
+#endif
+
+/**
+ * @brief Common sink of every debounce backend, records the press latency and passes level changes on.
+ *        Expects _btn_lock to be held
+ * 
+ * @param [in] btn The button that settled
+ * @param [in] active The debounced level
+ * @param [in] timestamp Cycle count of the first edge of the transition
+ */
+static void _btn_debounced(btn_gpio *btn, bool active, uint32_t timestamp) {
+  if (active == btn->active) {
+    return; // Bounced back to where it started
+  }
+  btn->active = active;
+
+  if (active) {
+    uint32_t latency_us = k_cyc_to_us_floor32(k_cycle_get_32() - timestamp);
+    _btn_latency.count++;
+    _btn_latency.last_us = latency_us;
+    _btn_latency.max_us = MAX(_btn_latency.max_us, latency_us);
+    _btn_latency.total_us += latency_us;
+  }
+
+  _btn_report(btn, active ? BTN_EVENT_PRESS : BTN_EVENT_RELEASE, timestamp);
+}
+
+/**
+ * @brief Runs a debounced transition through the chord recognizer. Presses of chord members are held
+ *        back for the coincidence window, if every member goes down inside it a single chord event
+ *        is reported instead of the individual presses and releases.
+ * 
+ * @param [in] btn The button that changed state
+ * @param [in] type BTN_EVENT_PRESS or BTN_EVENT_RELEASE
+ * @param [in] timestamp Cycle count of the first edge of the transition
+ */
+static void _btn_report(btn_gpio *btn, btn_event_type type, uint32_t timestamp) {
+  uint32_t bit = BIT(btn->id);
+
+  if (!(_btn_chord.mask & bit)) {
+    _btn_event_post(btn->id, type, bit, timestamp);
+    return;
+  }
+
+  if (BTN_EVENT_PRESS == type) {
+    _btn_chord.pending |= bit;
+    _btn_chord.timestamps[btn->id] = timestamp;
+
+    if (_btn_chord.pending == _btn_chord.mask) {
+      k_work_cancel_delayable(&_btn_chord.work);
+
+      uint32_t earliest = timestamp;
+      for (int i = 0; i < NUM_BTNS; i++) {
+        if ((_btn_chord.mask & BIT(i)) && (int32_t)(_btn_chord.timestamps[i] - earliest) < 0) {
+          earliest = _btn_chord.timestamps[i];
+        }
+      }
+      _btn_event_post(find_lsb_set(_btn_chord.mask) - 1, BTN_EVENT_CHORD, _btn_chord.mask, earliest);
+      _btn_chord.consumed = _btn_chord.mask;
+      _btn_chord.pending = 0;
+    } else if (_btn_chord.pending == bit) {
+      _btn_chord.window_start_ms = k_uptime_get_32();
+      k_work_schedule(&_btn_chord.work, K_MSEC(_btn_chord.window_ms));
+    }
+  } else {
+    if (_btn_chord.consumed & bit) {
+      // Already reported as part of the chord
+      _btn_chord.consumed &= ~bit;
+      return;
+    }
+    if (_btn_chord.pending & bit) {
+      // Let go before the window closed, it was a single press after all
+      k_work_cancel_delayable(&_btn_chord.work);
+      _btn_chord_flush();
+    }
+    _btn_event_post(btn->id, BTN_EVENT_RELEASE, bit, timestamp);
+  }
+}
+
+/**
+ * @brief Reports the held back presses of a chord that didn't complete, oldest first
+ */
+static void _btn_chord_flush() {
+  while (_btn_chord.pending) {
+    btn_id oldest = find_lsb_set(_btn_chord.pending) - 1;
+    for (int i = oldest + 1; i < NUM_BTNS; i++) {
+      if ((_btn_chord.pending & BIT(i)) &&
+          (int32_t)(_btn_chord.timestamps[i] - _btn_chord.timestamps[oldest]) < 0) {
+        oldest = i;
+      }
+    }
+    _btn_chord.pending &= ~BIT(oldest);
+    _btn_event_post(oldest, BTN_EVENT_PRESS, BIT(oldest), _btn_chord.timestamps[oldest]);
+  }
+}
+
+/**
+ * @brief Called when the chord coincidence window closes without every member being pressed
+ * 
+ * @param [in] work A k_work struct contained by the k_work_delayable inside _btn_chord
+ */
+static void _btn_chord_timeout(struct k_work *work __attribute__((unused))) {
+  k_spinlock_key_t key = k_spin_lock(&_btn_lock);
+
+  // A press can land between this firing and it taking the lock, only flush a window that really closed
+  uint32_t open_ms = k_uptime_get_32() - _btn_chord.window_start_ms;
+  if (_btn_chord.pending && open_ms < _btn_chord.window_ms) {
+    k_work_schedule(&_btn_chord.work, K_MSEC(_btn_chord.window_ms - open_ms));
+  } else {
+    _btn_chord_flush();
+  }
+
+  k_spin_unlock(&_btn_lock, key);
+}
+
+/**
+ * @brief Queues a button event for the registered callback, or for BTN_event_get() if there is none.
+ *        Never blocks, counts the event as an overflow if there is no room. Expects _btn_lock to be held
+ * 
+ * @param [in] btn The button the event belongs to
+ * @param [in] type The kind of event
+ * @param [in] mask Every button involved in the event
+ * @param [in] timestamp Cycle count of the first edge that led to the event
+ */
+static void _btn_event_post(btn_id btn, btn_event_type type, uint32_t mask, uint32_t timestamp) {
+  btn_event evt = {.btn=btn, .type=type, .mask=mask, .timestamp=timestamp};
+
+  if (BTN_EVENT_PRESS == type) {
+    _btns[btn].pressed = true;
+  }
+
+  if (NULL != _btn_callback) {
+    if (_btn_callback_head - _btn_callback_tail < CONFIG_BTN_EVENT_QUEUE_SIZE) {
+      _btn_callback_events[_btn_callback_head % CONFIG_BTN_EVENT_QUEUE_SIZE] = evt;
+      _btn_callback_head++;
+      k_work_submit(&_btn_callback_work);
+    } else {
+      atomic_inc(&_btn_event_overflows);
+    }
+  } else if (0 != k_msgq_put(&_btn_event_queue, &evt, K_NO_WAIT)) {
+    atomic_inc(&_btn_event_overflows);
+  }
+
+  if (BTN_EVENT_PRESS == type || BTN_EVENT_RELEASE == type) {
+    _btn_gesture_track(&_btns[btn], type, timestamp);
+  }
+}
+
+/**
+ * @brief Gets how many more events can be posted without an overflow. Expects _btn_lock to be held
+ * 
+ * @return Free slots of the path _btn_event_post() currently uses
+ */
+static uint32_t _btn_event_room() {
+  if (NULL != _btn_callback) {
+    return CONFIG_BTN_EVENT_QUEUE_SIZE - (_btn_callback_head - _btn_callback_tail);
+  }
+  return k_msgq_num_free_get(&_btn_event_queue);
+}
+
+/**
+ * @brief Hands the queued events to the registered callback from the system workqueue, outside
+ *        _btn_lock. The callback gets a pointer to the slot itself, it is only reused once the call
+ *        returned. Events left over after the callback was unregistered go to the event queue
+ * 
+ * @param [in] work The _btn_callback_work item
+ */
+static void _btn_callback_deliver(struct k_work *work __attribute__((unused))) {
+  k_spinlock_key_t key = k_spin_lock(&_btn_lock);
+
+  while (_btn_callback_tail != _btn_callback_head) {
+    btn_event *evt = &_btn_callback_events[_btn_callback_tail % CONFIG_BTN_EVENT_QUEUE_SIZE];
+    btn_callback cb = _btn_callback;
+    void *user_data = _btn_callback_user_data;
+
+    if (NULL == cb) {
+      if (0 != k_msgq_put(&_btn_event_queue, evt, K_NO_WAIT)) {
+        atomic_inc(&_btn_event_overflows);
+      }
+    } else {
+      k_spin_unlock(&_btn_lock, key);
+      cb(evt, user_data);
+      key = k_spin_lock(&_btn_lock);
+    }
+    _btn_callback_tail++;
+  }
+
+  k_spin_unlock(&_btn_lock, key);
+}
+
+/**
+ * @brief Feeds a reported press/release into the button's gesture classifier
+ * 
+ * @param [in] btn The button that was pressed or released
+ * @param [in] type BTN_EVENT_PRESS or BTN_EVENT_RELEASE
+ * @param [in] timestamp Cycle count of the edge
+ */
+static void _btn_gesture_track(btn_gpio *btn, btn_event_type type, uint32_t timestamp) {
+  btn_gesture *g = &btn->gesture;
+  if (!g->enabled) {
+    return;
+  }
+
+  k_work_cancel_delayable(&g->work);
+
+  if (BTN_EVENT_PRESS == type) {
+    g->second_press = g->click_pending;
+    g->click_pending = false;
+    g->held = true;
+    g->hold_reported = false;
+    g->press_ms = k_uptime_get_32();
+    g->press_timestamp = timestamp;
+    g->next_repeat_ms = g->config.repeat_delay_ms;
+
+    if (g->config.long_press_ms || g->config.repeat_delay_ms) {
+      uint32_t first = g->config.long_press_ms;
+      if (!first || (g->config.repeat_delay_ms && g->config.repeat_delay_ms < first)) {
+        first = g->config.repeat_delay_ms;
+      }
+      k_work_schedule(&g->work, K_MSEC(first));
+    }
+    return;
+  }
+
+  g->held = false;
+  if (g->hold_reported) {
+    return;
+  } else if (g->second_press) {
+    g->second_press = false;
+    _btn_event_post(btn->id, BTN_EVENT_DOUBLE_CLICK, BIT(btn->id), g->press_timestamp);
+  } else if (g->config.double_click_ms) {
+    g->click_pending = true;
+    g->release_ms = k_uptime_get_32();
+    k_work_schedule(&g->work, K_MSEC(g->config.double_click_ms));
+  } else {
+    _btn_event_post(btn->id, BTN_EVENT_CLICK, BIT(btn->id), g->press_timestamp);
+  }
+}
+
+/**
+ * @brief Times a button's gestures. While held it reports long presses and repeats,
+ *        once released it reports the click if no second press came inside the double click window
+ * 
+ * @param [in] work A k_work struct contained by a k_work_delayable inside a btn_gesture struct
+ */
+static void _btn_gesture_timeout(struct k_work *_work) {
+  struct k_work_delayable *dwork = CONTAINER_OF(_work, struct k_work_delayable, work);
+  btn_gesture *g = CONTAINER_OF(dwork, btn_gesture, work);
+  btn_gpio *btn = CONTAINER_OF(g, btn_gpio, gesture);
+
+  k_spinlock_key_t key = k_spin_lock(&_btn_lock);
+  _btn_gesture_step(btn, g);
+  k_spin_unlock(&_btn_lock, key);
+}
+
+/**
+ * @brief Body of _btn_gesture_timeout, expects _btn_lock to be held
+ * 
+ * @param [in] btn The button being timed
+ * @param [in] g The button's gesture state
+ */
+static void _btn_gesture_step(btn_gpio *btn, btn_gesture *g) {
+  if (g->click_pending) {
+    // An edge can land between this firing and it taking the lock, only report a window that really closed
+    uint32_t open_ms = k_uptime_get_32() - g->release_ms;
+    if (open_ms < g->config.double_click_ms) {
+      k_work_schedule(&g->work, K_MSEC(g->config.double_click_ms - open_ms));
+      return;
+    }
+    g->click_pending = false;
+    _btn_event_post(btn->id, BTN_EVENT_CLICK, BIT(btn->id), g->press_timestamp);
+    return;
+  } else if (!g->held) {
+    return;
+  }
+
+  uint32_t held_ms = k_uptime_get_32() - g->press_ms;
+  uint32_t next_ms = UINT32_MAX;
+
+  if (g->config.long_press_ms) {
+    if (!g->hold_reported && held_ms >= g->config.long_press_ms) {
+      _btn_event_post(btn->id, BTN_EVENT_LONG_PRESS, BIT(btn->id), k_cycle_get_32());
+      g->hold_reported = true;
+    } else if (held_ms < g->config.long_press_ms) {
+      next_ms = g->config.long_press_ms;
+    }
+  }
+
+  if (g->config.repeat_delay_ms) {
+    if (held_ms >= g->next_repeat_ms) {
+      _btn_event_post(btn->id, BTN_EVENT_REPEAT, BIT(btn->id), k_cycle_get_32());
+      g->hold_reported = true;
+      g->next_repeat_ms += MAX(g->config.repeat_interval_ms, 1);
+    }
+    next_ms = MIN(next_ms, g->next_repeat_ms);
+  }
+
+  if (UINT32_MAX != next_ms) {
+    k_work_schedule(&g->work, K_MSEC(next_ms > held_ms ? next_ms - held_ms : 0));
   }
 }
 
@@ -117,12 +682,24 @@ static void _btn_debounce(struct k_work *_work) {
  * @return Error code, < 0 on failures
  */
 int BTN_init() {
-  for (uint8_t i = 0; i < NUM_BTNS; i++) {
-    int rv = _btn_config(_btns[i]);
+  k_work_init_delayable(&_btn_chord.work, _btn_chord_timeout);
+  for (int i = 0; i < NUM_BTNS; i++) {
+    _btns[i].spec = &_btn_specs[i];
+    _btns[i].id = i;
+    int rv = _btn_config(&_btns[i]);
+    if (rv < 0) {
+      return rv;
+    }
+  }
+#ifndef CONFIG_BTN_DEBOUNCE_INPUT
+  for (uint8_t i = 0; i < _btn_num_ports; i++) {
+    gpio_init_callback(&_btn_ports[i].cb, _btn_interrupt_service_routine, _btn_ports[i].pins);
+    int rv = gpio_add_callback(_btn_ports[i].dev, &_btn_ports[i].cb);
     if (rv < 0) {
       return rv;
     }
   }
+#endif
   return 0;
 }
 
@@ -136,7 +713,7 @@ int BTN_init() {
 bool BTN_is_pressed(btn_id btn) {
   if (IS_INVALID_BTN(btn)) {
     return false;
-  } else if (0 < gpio_pin_get_dt(&_btns[btn]->spec)) {
+  } else if (0 < gpio_pin_get_dt(&_btn_specs[btn])) {
     return true;
   } else {
     return false;
@@ -145,7 +722,8 @@ bool BTN_is_pressed(btn_id btn) {
 
 /**
  * @brief Checks if the given button has been pressed, clears internal state flag.
- *        Equivalent to calling BTN_check_pressed(BTNx) then calling BTN_clear_pressed(BTNx)
+ *        Equivalent to calling BTN_check_pressed(BTNx) then calling BTN_clear_pressed(BTNx).
+ *        Kept for polling code, the flag is set from the same press events BTN_event_get() returns
  * 
  * @param [in] btn Which button to check
  * 
@@ -155,8 +733,8 @@ bool BTN_check_clear_pressed(btn_id btn) {
   if (IS_INVALID_BTN(btn)) {
     return false;
   } else {
-    bool was_pressed = _btns[btn]->pressed;
-    _btns[btn]->pressed = false;
+    bool was_pressed = _btns[btn].pressed;
+    _btns[btn].pressed = false;
     return was_pressed;
   }
 }
@@ -172,7 +750,7 @@ bool BTN_check_pressed(btn_id btn) {
   if (IS_INVALID_BTN(btn)) {
     return false;
   } else {
-    return _btns[btn]->pressed;
+    return _btns[btn].pressed;
   }
 }
 
@@ -185,7 +763,221 @@ void BTN_clear_pressed(btn_id btn) {
   if (IS_INVALID_BTN(btn)) {
     return;
   } else {
-    _btns[btn]->pressed = false;
+    _btns[btn].pressed = false;
+    return;
+  }
+}
+
+/**
+ * @brief Takes the oldest debounced button event from the queue. Events only land there while no
+ *        callback is registered with BTN_callback_set()
+ * 
+ * @param [out] evt Filled with the event on success
+ * @param [in] timeout How long to wait for an event, K_FOREVER to block, K_NO_WAIT to poll
+ * 
+ * @return 0 on success, -ENOMSG if polling an empty queue, -EAGAIN if the timeout expired, -EINVAL on a NULL evt
+ */
+int BTN_event_get(btn_event *evt, k_timeout_t timeout) {
+  if (NULL == evt) {
+    return -EINVAL;
+  }
+  return k_msgq_get(&_btn_event_queue, evt, timeout);
+}
+
+/**
+ * @brief Delivers every button event to a callback instead of the event queue. The callback runs on
+ *        the system workqueue without any driver lock held, one event at a time and in order. It
+ *        gets a pointer to the event in the driver's ring, only valid for the duration of the call,
+ *        so nothing is copied on the way. Events that arrive while the callback is still busy wait
+ *        in the ring, up to CONFIG_BTN_EVENT_QUEUE_SIZE of them
+ * 
+ * @param [in] cb The callback, NULL goes back to queueing events for BTN_event_get()
+ * @param [in] user_data Passed to every call of cb
+ */
+void BTN_callback_set(btn_callback cb, void *user_data) {
+  k_spinlock_key_t key = k_spin_lock(&_btn_lock);
+  _btn_callback = cb;
+  _btn_callback_user_data = user_data;
+  k_spin_unlock(&_btn_lock, key);
+}
+
+/**
+ * @brief Gets how many events were dropped because the event queue was full
+ * 
+ * @return Number of dropped events since boot
+ */
+uint32_t BTN_event_overflows() {
+  return (uint32_t)atomic_get(&_btn_event_overflows);
+}
+
+/**
+ * @brief Sets up chord detection. Pressing every button in mask within window_ms of each other reports a
+ *        single BTN_EVENT_CHORD instead of the individual presses. Presses of the member buttons are
+ *        delayed by up to window_ms while the driver waits for the rest of the chord.
+ * 
+ * @param [in] mask The buttons that make up the chord, at least two. 0 turns chord detection off
+ * @param [in] window_ms The coincidence window in ms
+ * 
+ * @return Error code, < 0 on failures
+ */
+int BTN_chord_config(uint32_t mask, uint32_t window_ms) {
+  if (0 != mask && ((mask & ~BTN_MASK_ALL) || 2 > POPCOUNT(mask) || 0 == window_ms)) {
+    return -EINVAL;
+  }
+
+  k_spinlock_key_t key = k_spin_lock(&_btn_lock);
+  k_work_cancel_delayable(&_btn_chord.work);
+  _btn_chord_flush();
+
+  _btn_chord.consumed = 0;
+  _btn_chord.window_ms = window_ms;
+  _btn_chord.mask = mask;
+  k_spin_unlock(&_btn_lock, key);
+  return 0;
+}
+
+/**
+ * @brief Turns on gesture classification for a button. On top of its press/release events the button then
+ *        reports clicks, double clicks, long presses and auto-repeats with the given timing
+ * 
+ * @param [in] btn Which button to configure
+ * @param [in] config The gesture timing, NULL turns gestures off for the button
+ * 
+ * @return Error code, < 0 on failures
+ */
+int BTN_gesture_config(btn_id btn, const btn_gesture_config *config) {
+  if (IS_INVALID_BTN(btn)) {
+    return -EINVAL;
+  }
+
+  btn_gesture *g = &_btns[btn].gesture;
+  k_spinlock_key_t key = k_spin_lock(&_btn_lock);
+  k_work_cancel_delayable(&g->work);
+  g->enabled = false;
+  g->click_pending = false;
+  g->second_press = false;
+  g->hold_reported = false;
+
+  if (NULL != config) {
+    g->config = *config;
+    g->held = _btns[btn].active;
+    g->hold_reported = g->held; // A press already in progress never becomes a click
+    g->enabled = true;
+  }
+  k_spin_unlock(&_btn_lock, key);
+  return 0;
+}
+
+/**
+ * @brief Gets the press latency measured by the debounce backend, from the first edge to the press being reported
+ * 
+ * @param [out] stats Filled with a snapshot of the latency statistics
+ */
+void BTN_latency_get(btn_latency *stats) {
+  if (NULL == stats) {
     return;
   }
+  k_spinlock_key_t key = k_spin_lock(&_btn_lock);
+  *stats = _btn_latency;
+  k_spin_unlock(&_btn_lock, key);
+}
+
+/**
+ * @brief Gets the current level of every button from one raw read per GPIO port, so buttons
+ *        sharing a port are seen at the same instant
+ * 
+ * @return Bitmask of the buttons being pressed, BIT(BTNx) set if BTNx is active
+ */
+uint32_t BTN_get_mask() {
+  gpio_port_value_t raw[NUM_BTNS] = {0};
+  for (uint8_t i = 0; i < _btn_num_ports; i++) {
+    gpio_port_get_raw(_btn_ports[i].dev, &raw[i]);
+  }
+
+  uint32_t mask = 0;
+  for (int i = 0; i < NUM_BTNS; i++) {
+    if (_btns[i].port && _btn_level(&_btns[i], raw[_btns[i].port - _btn_ports])) {
+      mask |= BIT(i);
+    }
+  }
+  return mask;
+}
+
+#ifdef CONFIG_BTN_INJECT
+/**
+ * @brief Worst case number of events one injected transition posts. A press posts itself or
+ *        completes a chord. A release can flush every held back chord press, then posts itself
+ *        and a click or double click. Expects _btn_lock to be held
+ * 
+ * @param [in] pressed The level being injected
+ * 
+ * @return Queue slots the transition may need
+ */
+static uint32_t _btn_inject_room(bool pressed) {
+  return pressed ? 1 : POPCOUNT(_btn_chord.pending) + 2;
+}
+
+/**
+ * @brief Checks whether the real button is in the middle of something. Expects _btn_lock to be held
+ * 
+ * @param [in] btn The button to check
+ * 
+ * @return true while it is held down or its debounce backend hasn't settled
+ */
+static bool _btn_inject_busy(const btn_gpio *btn) {
+#if defined(CONFIG_BTN_DEBOUNCE_WORK)
+  if (k_work_delayable_is_pending(&btn->work)) {
+    return true;
+  }
+#elif defined(CONFIG_BTN_DEBOUNCE_SAMPLED)
+  if (atomic_get(&_btn_sampling) & BIT(btn->id)) {
+    return true;
+  }
+#elif defined(CONFIG_BTN_DEBOUNCE_LOCKOUT)
+  if (btn->locked) {
+    return true;
+  }
+#endif
+  return 0 < gpio_pin_get_dt(btn->spec);
+}
+
+/**
+ * @brief Feeds a virtual press or release in where the debounce backends hand over theirs, so chords,
+ *        gestures and the event queue treat it like a real button. Injected transitions are already
+ *        clean and skip the press latency statistics. The button's level is shared with the real
+ *        one, so nothing is injected while it is held down or debouncing
+ * 
+ * @param [in] btn The button to press or release
+ * @param [in] pressed The new level
+ * @param [in] timestamp Cycle count the event carries, in k_cycle_get_32() time
+ * 
+ * @return 0 on success, also when the button already had that level, -EAGAIN if the event queue
+ *         doesn't have room for every event it could cause, -EBUSY while the real button is in use,
+ *         -EINVAL on an invalid button
+ */
+int BTN_inject(btn_id btn, bool pressed, uint32_t timestamp) {
+  if (IS_INVALID_BTN(btn)) {
+    return -EINVAL;
+  }
+
+  k_spinlock_key_t key = k_spin_lock(&_btn_lock);
+  btn_gpio *b = &_btns[btn];
+  if (NULL == b->spec) {
+    k_spin_unlock(&_btn_lock, key);
+    return -EAGAIN; // BTN_init hasn't run yet
+  } else if (_btn_inject_busy(b)) {
+    k_spin_unlock(&_btn_lock, key);
+    return -EBUSY;
+  } else if (_btn_event_room() < _btn_inject_room(pressed)) {
+    k_spin_unlock(&_btn_lock, key);
+    return -EAGAIN;
+  }
+
+  if (pressed != b->active) {
+    b->active = pressed;
+    _btn_report(b, pressed ? BTN_EVENT_PRESS : BTN_EVENT_RELEASE, timestamp);
+  }
+  k_spin_unlock(&_btn_lock, key);
+  return 0;
 }
+#endif
@@ -6,16 +6,28 @@ Header to define led interface
 #define LED_H
 
 #include "stdint.h"
+#include <zephyr/devicetree.h>
+
+/* ----------------------------------------------------------------------------
+                                    Constants
+---------------------------------------------------------------------------- */
+#define LED_NODE              DT_COMPAT_GET_ANY_STATUS_OKAY(eie_pwm_leds)
+
+// One LED per enabled child of the eie,pwm-leds node, in devicetree order
+#define NUM_LEDS              DT_CHILD_NUM_STATUS_OKAY(LED_NODE)
+
+// Every LED, for the led_mask arguments
+#define LED_MASK_ALL          (UINT32_MAX >> (32 - NUM_LEDS))
 
 /* ----------------------------------------------------------------------------
                                     TYPES
 ---------------------------------------------------------------------------- */
+// Names for the first LEDs, boards with more pass the plain index
 typedef enum led_id_t {
   LED0 = 0,
   LED1,
   LED2,
   LED3,
-  NUM_LEDS,
 } led_id;
 
 typedef enum led_state_t {
@@ -31,6 +43,28 @@ typedef enum led_frequency_t {
   LED_16HZ = 16,
 } led_frequency;
 
+typedef enum led_curve_t {
+  LED_CURVE_LINEAR = 0,
+  LED_CURVE_EASE_IN, // Quadratic
+  LED_CURVE_EASE_IN_OUT, // Smoothstep
+} led_curve;
+
+// One LED's part of LED_fade_many(), levels are perceived brightness like LED_brightness()
+typedef struct led_fade_t {
+  uint16_t from; // 0 - UINT16_MAX
+  uint16_t to; // 0 - UINT16_MAX, held once the fade is done
+  uint32_t duration_ms; // 0 jumps straight to to
+  led_curve curve;
+} led_fade;
+
+// Time from LED_fade_many() queueing a frame to the service thread loading it into the PWM
+typedef struct led_latency_t {
+  uint32_t count; // Frames measured
+  uint32_t last_us;
+  uint32_t max_us;
+  uint64_t total_us; // Divide by count for the mean
+} led_latency;
+
 /* ----------------------------------------------------------------------------
                               Public Functions
 ---------------------------------------------------------------------------- */
@@ -42,6 +76,24 @@ int LED_set(led_id led, led_state new_state);
 
 int LED_pwm(led_id led, uint8_t duty_cycle);
 
-void LED_blink(led_id led, led_frequency frequency);
+int LED_brightness(led_id led, uint16_t brightness);
+
+int LED_blink(led_id led, led_frequency frequency);
+
+int LED_blink_custom(led_id led, uint32_t period_ms, uint8_t duty_cycle);
+
+int LED_fade(led_id led, uint8_t from, uint8_t to, uint32_t duration_ms, led_curve curve);
+
+int LED_breathe(led_id led, uint8_t min, uint8_t max, uint32_t period_ms, led_curve curve);
+
+int LED_set_many(uint32_t led_mask, const uint8_t duty_cycles[NUM_LEDS]);
+
+int LED_commit();
+
+int LED_fade_many(uint32_t led_mask, const led_fade fades[NUM_LEDS]);
+
+int LED_carrier(led_id led, uint32_t frequency_hz, uint16_t resolution);
+
+void LED_latency_get(led_latency *stats);
 
 #endif
\ No newline at end of file
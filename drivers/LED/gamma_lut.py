@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+"""
+Generates the gamma lookup table of the led module. Runs on the build host,
+the firmware only interpolates between the entries with integer math.
+"""
+
+import argparse
+import sys
+
+LUT_SIZE = 257  # 256 segments, the last entry is full brightness
+LEVEL_MAX = 0xFFFF
+
+
+def generate(gamma):
+    return [round(LEVEL_MAX * (i / (LUT_SIZE - 1)) ** gamma) for i in range(LUT_SIZE)]
+
+
+def check(lut):
+    if lut[0] != 0 or lut[-1] != LEVEL_MAX:
+        return "table has to run from 0 to {}".format(LEVEL_MAX)
+    for i in range(1, len(lut)):
+        if lut[i] < lut[i - 1]:
+            return "table isn't monotonic at entry {}".format(i)
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--gamma-x100", type=int, required=True, help="gamma exponent times 100")
+    parser.add_argument("--output", required=True, help="header to write")
+    args = parser.parse_args()
+
+    lut = generate(args.gamma_x100 / 100)
+    error = check(lut)
+    if error:
+        sys.exit("gamma_lut.py: " + error)
+
+    rows = []
+    for i in range(0, LUT_SIZE, 8):
+        rows.append("  " + " ".join("{:5d},".format(v) for v in lut[i:i + 8]))
+
+    with open(args.output, "w") as f:
+        f.write("/*\nGenerated by gamma_lut.py with gamma {:.2f}, do not edit\n*/\n\n".format(args.gamma_x100 / 100))
+        f.write("#ifndef LED_GAMMA_LUT_H\n#define LED_GAMMA_LUT_H\n\n")
+        f.write("#include \"stdint.h\"\n\n")
+        f.write("#define LED_GAMMA_LUT_SIZE {}\n\n".format(LUT_SIZE))
+        f.write("static const uint16_t led_gamma_lut[LED_GAMMA_LUT_SIZE] = {\n")
+        f.write("\n".join(rows))
+        f.write("\n};\n\n#endif\n")
+
+
+if __name__ == "__main__":
+    main()
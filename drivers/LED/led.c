@@ -1,73 +1,143 @@
 /*
-Header to define led module logic
+Header to define led module logic. The LED state belongs to one service thread, the public
+functions only validate their arguments and queue a command for it
 */
 
 #include <zephyr/kernel.h>
 #include <zephyr/drivers/pwm.h>
+#include <zephyr/sys/atomic.h>
 #include <inttypes.h>
 
 #include "LED.h"
+#ifdef CONFIG_LED_HW_SEQUENCER
+#include "led_seq.h"
+#endif
+#include "led_wave.h"
+#include "led_ring.h"
 
 /* ----------------------------------------------------------------------------
                                     Constants
 ---------------------------------------------------------------------------- */
-#define LED_BLINK_STACK_SIZE      384
-#define LED_BLINK_PRIORITY        1
-#define LED_COUNTER_UNIT          100 // Units per ms (1 unit == 10us)
-#define LED_COUNTER_HALF_PERIOD   500 * LED_COUNTER_UNIT // Units per half second (1 second / 2 == 500ms)
+#define LED_SERVICE_STACK_SIZE    1024
+#define LED_SERVICE_PRIORITY      1
 
 #define PWM_MAX_DUTY_CYCLE        100 // Valid duty cycle range for this application is 0 - 100
 
 /* ----------------------------------------------------------------------------
                                   Macro Helpers
 ---------------------------------------------------------------------------- */
-#define LED0_NODE             DT_ALIAS(pwm_led0)
-#define LED1_NODE             DT_ALIAS(pwm_led1)
-#define LED2_NODE             DT_ALIAS(pwm_led2)
-#define LED3_NODE             DT_ALIAS(pwm_led3)
-
 #define IS_INVALID_LED(led)   (led >= NUM_LEDS || led < 0)
+#define IS_INVALID_MASK(mask) ((mask) & ~LED_MASK_ALL)
+
+// Public duty cycles are 0 - 100, everything below the API works in 0 - LED_WAVE_MAX
+#define PERCENT_TO_LEVEL(p)   ((uint32_t)MIN(p, PWM_MAX_DUTY_CYCLE) * LED_WAVE_MAX / PWM_MAX_DUTY_CYCLE)
+
+#define LED_SPEC_INIT(node)   PWM_DT_SPEC_GET(node)
+
+BUILD_ASSERT(NUM_LEDS > 0 && NUM_LEDS <= 32, "LED masks are 32 bits, the eie,pwm-leds node needs 1 - 32 children");
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_LED_CMD_QUEUE_SIZE), "CONFIG_LED_CMD_QUEUE_SIZE must be a power of two");
 
 /* ----------------------------------------------------------------------------
                                     Types
 ---------------------------------------------------------------------------- */
-typedef struct led_blink_t {
-  uint16_t half_period; // Units of 10us
-  uint16_t offset; // Units of 10us
-} led_blink;
-
 typedef struct led_t {
-  struct pwm_dt_spec spec; 
-  led_blink blink;
-  uint8_t current_duty_cycle; // Valid from 0 - 100
+  led_wave wave; // Played by the service thread
+  int64_t wave_start; // Uptime ticks, every edge is scheduled from here so phase never drifts
+  uint32_t loop_start_ms; // Start of the current loop since wave_start, moved on by whole loops
+  uint32_t period; // Carrier period in ns, starts at the devicetree value (Zephyr PWM path)
+  uint16_t current_duty_cycle; // Valid from 0 - LED_WAVE_MAX
 } led_type;
 
-typedef struct blink_thread_t {
+typedef struct led_frame_t {
+  uint32_t led_mask; // LEDs staged since the last commit
+  uint16_t duty_cycles[NUM_LEDS]; // 0 - LED_WAVE_MAX
+} led_frame;
+
+typedef enum led_cmd_type_t {
+  LED_CMD_PWM = 0, // Steady duty cycle, halts any waveform
+  LED_CMD_TOGGLE,
+  LED_CMD_PLAY,
+  LED_CMD_STAGE,
+  LED_CMD_COMMIT,
+  LED_CMD_CARRIER,
+  LED_CMD_FADE_MANY,
+} led_cmd_type;
+
+typedef struct led_cmd_t {
+  led_cmd_type type;
+  led_id led;
+  union {
+    uint16_t duty_cycle; // 0 - LED_WAVE_MAX
+    led_wave wave;
+    led_frame frame;
+    struct {
+      uint32_t frequency_hz;
+      uint16_t resolution;
+    } carrier;
+    struct {
+      uint32_t led_mask;
+      uint32_t queued; // Cycle count when queued, for LED_latency_get()
+      led_fade fades[NUM_LEDS];
+    } fade_many;
+  };
+} led_cmd;
+
+typedef struct led_service_t {
   struct k_thread thread;
   k_tid_t id;
-  uint8_t led_bitmask;
-} blink_thread;
+  struct k_sem wake; // Given for every queued command
+  struct k_sem room; // Given after the thread drained the queue, wakes a thread waiting on a full queue
+  uint32_t led_bitmask; // LEDs whose waveform the thread plays
+} led_service;
 
 /* ----------------------------------------------------------------------------
                             Private Function Prototypes
 ---------------------------------------------------------------------------- */
-static int _led_pwm_preserve_blink(led_id led, uint8_t duty_cycle);
+static int _led_pwm_preserve_blink(led_id led, uint16_t duty_cycle);
 
 static void _led_halt_blink(led_id led);
 
-static void _led_blink_loop(void *led, void *p2, void *p3);
+static void _led_halt_blinks(uint32_t led_mask);
+
+static int _led_play(led_id led, const led_wave *wave);
+
+static int _led_commit();
+
+static int _led_play_many(uint32_t led_mask, const led_wave waves[NUM_LEDS]);
+
+static int _led_carrier(led_id led, uint32_t frequency_hz, uint16_t resolution);
+
+static int _led_cmd_push(const led_cmd *cmd);
+
+static bool _led_cmd_pop(led_cmd *cmd);
+
+static void _led_cmd_apply(const led_cmd *cmd);
+
+static void _led_service_loop(void *p1, void *p2, void *p3);
 
 /* ----------------------------------------------------------------------------
                                 Global States
 ---------------------------------------------------------------------------- */
-static led_type _led0 = {.spec=PWM_DT_SPEC_GET(LED0_NODE), .current_duty_cycle=0};
-static led_type _led1 = {.spec=PWM_DT_SPEC_GET(LED1_NODE), .current_duty_cycle=0};
-static led_type _led2 = {.spec=PWM_DT_SPEC_GET(LED2_NODE), .current_duty_cycle=0};
-static led_type _led3 = {.spec=PWM_DT_SPEC_GET(LED3_NODE), .current_duty_cycle=0};
-static led_type *_leds[NUM_LEDS] = {&_led0, &_led1, &_led2, &_led3};
+// The sequencer backend owns the PWM instance, there is no Zephyr PWM device to point at
+#ifndef CONFIG_LED_HW_SEQUENCER
+static const struct pwm_dt_spec _led_specs[NUM_LEDS] = {
+  DT_FOREACH_CHILD_STATUS_OKAY_SEP(LED_NODE, LED_SPEC_INIT, (,))
+};
+#endif
+
+static led_type _leds[NUM_LEDS];
+
+static led_service _led_service = {.led_bitmask=0};
+static led_frame _led_frame = {.led_mask=0};
+K_THREAD_STACK_DEFINE(_led_service_stack, LED_SERVICE_STACK_SIZE);
 
-static blink_thread _led_blink_thread = {.led_bitmask=0};
-K_THREAD_STACK_DEFINE(_led_blink_stack, LED_BLINK_STACK_SIZE);
+// Bounded multi-producer single-consumer ring, producers claim a position with one CAS
+static led_cmd _led_cmds[CONFIG_LED_CMD_QUEUE_SIZE];
+static atomic_t _led_cmd_sequences[CONFIG_LED_CMD_QUEUE_SIZE];
+static led_ring _led_cmd_ring; // Set up by LED_init()
+
+static led_latency _led_latency = {.count=0};
+static struct k_spinlock _led_latency_lock;
 
 /* ----------------------------------------------------------------------------
                               Private Functions
@@ -76,18 +146,22 @@ K_THREAD_STACK_DEFINE(_led_blink_stack, LED_BLINK_STACK_SIZE);
  * @brief Sets the LED to the given duty cycle, doesn't halt blinking
  * 
  * @param [in] led the LED to set the duty cycle of
- * @param [in] duty_cycle the duty cycle to set the LED to
+ * @param [in] duty_cycle the duty cycle to set the LED to, 0 - LED_WAVE_MAX
  * 
  * @return Error code, < 0 on failures
  */
-static int _led_pwm_preserve_blink(led_id led, uint8_t duty_cycle) {
+static int _led_pwm_preserve_blink(led_id led, uint16_t duty_cycle) {
   if (IS_INVALID_LED(led)) {
     return -EINVAL;
   }
-  uint8_t clamped_duty_cycle = PWM_MAX_DUTY_CYCLE < duty_cycle ? PWM_MAX_DUTY_CYCLE : duty_cycle;
-  uint32_t pwm_step = _leds[led]->spec.period / PWM_MAX_DUTY_CYCLE;
-  // Subtract clamped duty cycle as leds are active low
-  return pwm_set_pulse_dt(&_leds[led]->spec, pwm_step * (PWM_MAX_DUTY_CYCLE - clamped_duty_cycle));
+#ifdef CONFIG_LED_HW_SEQUENCER
+  return led_seq_set(led, duty_cycle);
+#else
+  // Invert the duty cycle as leds are active low
+  const struct pwm_dt_spec *spec = &_led_specs[led];
+  uint32_t pulse = led_wave_scale(_leds[led].period, LED_WAVE_MAX - duty_cycle);
+  return pwm_set(spec->dev, spec->channel, _leds[led].period, pulse, spec->flags);
+#endif
 }
 
 /**
@@ -100,34 +174,316 @@ static void _led_halt_blink(led_id led) {
     return;
   }
 
-  _led_blink_thread.led_bitmask &= ~BIT(led);
-  if (!_led_blink_thread.led_bitmask) {
-    k_thread_suspend(_led_blink_thread.id);
+  _led_halt_blinks(BIT(led));
+}
+
+/**
+ * @brief Halts blinking for several LEDs at once
+ * 
+ * @param [in] led_mask BIT(led) for every LED to halt blinking for
+ */
+static void _led_halt_blinks(uint32_t led_mask) {
+  _led_service.led_bitmask &= ~led_mask;
+}
+
+/**
+ * @brief Plays a waveform on an LED. With CONFIG_LED_HW_SEQUENCER the PWM peripheral plays it on
+ *        its own, waveforms that don't fit its sequence table are played by the service thread
+ * 
+ * @param [in] led The LED instance to play the waveform on
+ * @param [in] wave The waveform, copied
+ * 
+ * @return Error code, < 0 on failures
+ */
+static int _led_play(led_id led, const led_wave *wave) {
+  if (IS_INVALID_LED(led)) {
+    return -EINVAL;
+  }
+
+  _led_halt_blink(led);
+  _leds[led].current_duty_cycle = wave->to;
+
+#ifdef CONFIG_LED_HW_SEQUENCER
+  if (0 == led_seq_play(led, wave)) {
+    return 0;
+  }
+  // Doesn't fit next to the other running patterns, play it from the thread instead
+#endif
+
+  _leds[led].wave = *wave;
+  _leds[led].wave_start = k_uptime_ticks();
+  _leds[led].loop_start_ms = 0;
+  _leds[led].current_duty_cycle = led_wave_sample(wave, 0);
+  _led_service.led_bitmask |= BIT(led);
+  return _led_pwm_preserve_blink(led, _leds[led].current_duty_cycle);
+}
+
+/**
+ * @brief Loads every staged duty cycle, halting blinking on those LEDs
+ * 
+ * @return Error code, < 0 on failures
+ */
+static int _led_commit() {
+  uint32_t led_mask = _led_frame.led_mask;
+  if (!led_mask) {
+    return 0;
+  }
+  _led_frame.led_mask = 0;
+
+  _led_halt_blinks(led_mask);
+  for (int i = 0; i < NUM_LEDS; i++) {
+    if (led_mask & BIT(i)) {
+      _leds[i].current_duty_cycle = _led_frame.duty_cycles[i];
+    }
+  }
+
+#ifdef CONFIG_LED_HW_SEQUENCER
+  return led_seq_set_many(led_mask, _led_frame.duty_cycles);
+#else
+  int rv = 0;
+  for (int i = 0; i < NUM_LEDS; i++) {
+    if (led_mask & BIT(i)) {
+      int err = _led_pwm_preserve_blink(i, _led_frame.duty_cycles[i]);
+      rv = rv < 0 ? rv : err;
+    }
+  }
+  return rv;
+#endif
+}
+
+/**
+ * @brief Plays waveforms on several LEDs at once. With CONFIG_LED_HW_SEQUENCER they go into one
+ *        render and start in the same PWM period, otherwise or when they don't fit the sequence
+ *        table the service thread plays them from one shared start
+ * 
+ * @param [in] led_mask BIT(led) for every LED to play a waveform on
+ * @param [in] waves Waveform per LED, indexed by led_id, only entries in led_mask are read
+ * 
+ * @return Error code, < 0 on failures
+ */
+static int _led_play_many(uint32_t led_mask, const led_wave waves[NUM_LEDS]) {
+  _led_halt_blinks(led_mask);
+  for (int i = 0; i < NUM_LEDS; i++) {
+    if (led_mask & BIT(i)) {
+      _leds[i].current_duty_cycle = waves[i].to;
+    }
+  }
+
+#ifdef CONFIG_LED_HW_SEQUENCER
+  if (0 == led_seq_play_many(led_mask, waves)) {
+    return 0;
   }
+  // Doesn't fit next to the other running patterns, play them from the thread instead
+#endif
+
+  int64_t start = k_uptime_ticks();
+  int rv = 0;
+  for (int i = 0; i < NUM_LEDS; i++) {
+    if (!(led_mask & BIT(i))) {
+      continue;
+    }
+    if (LED_WAVE_STEADY != waves[i].type) {
+      _leds[i].wave = waves[i];
+      _leds[i].wave_start = start;
+      _leds[i].loop_start_ms = 0;
+      _leds[i].current_duty_cycle = led_wave_sample(&waves[i], 0);
+      _led_service.led_bitmask |= BIT(i);
+    }
+    int err = _led_pwm_preserve_blink(i, _leds[i].current_duty_cycle);
+    rv = rv < 0 ? rv : err;
+  }
+  return rv;
 }
 
 /**
- * @brief Handles blinking all LEDs
+ * @brief Changes the carrier of an LED and every other LED on its PWM instance, they share one
+ *        prescaler and counter top
+ * 
+ * @param [in] led The LED instance
+ * @param [in] frequency_hz Carrier frequency
+ * @param [in] resolution Minimum brightness steps per period
+ * 
+ * @return Error code, < 0 on failures
+ */
+static int _led_carrier(led_id led, uint32_t frequency_hz, uint16_t resolution) {
+#ifdef CONFIG_LED_HW_SEQUENCER
+  ARG_UNUSED(led);
+  return led_seq_carrier(frequency_hz, resolution);
+#else
+  // The Zephyr PWM driver picks its own prescaler for the period, the resolution was checked up front
+  ARG_UNUSED(resolution);
+  int rv = 0;
+  for (int i = 0; i < NUM_LEDS; i++) {
+    if (_led_specs[i].dev == _led_specs[led].dev) {
+      _leds[i].period = NSEC_PER_SEC / frequency_hz;
+      int err = _led_pwm_preserve_blink(i, _leds[i].current_duty_cycle);
+      rv = rv < 0 ? rv : err;
+    }
+  }
+  return rv;
+#endif
+}
+
+/**
+ * @brief Queues a command for the service thread. On a full queue threads wait until the service
+ *        thread drained it, ISRs and the service thread itself can't wait and get -EAGAIN
+ * 
+ * @param [in] cmd The command, copied
+ * 
+ * @return Error code, -EAGAIN if the queue is full in an ISR or the service thread
+ */
+static int _led_cmd_push(const led_cmd *cmd) {
+  uint32_t position;
+  int rv = led_ring_claim(&_led_cmd_ring, &position);
+  while (-EAGAIN == rv) {
+    if (k_is_in_isr() || k_current_get() == _led_service.id) {
+      return rv;
+    }
+    // Main runs above the service thread, waiting here is what lets the service thread catch up
+    k_sem_take(&_led_service.room, K_FOREVER);
+    rv = led_ring_claim(&_led_cmd_ring, &position);
+  }
+
+  _led_cmds[position % CONFIG_LED_CMD_QUEUE_SIZE] = *cmd;
+  led_ring_publish(&_led_cmd_ring, position);
+  k_sem_give(&_led_service.wake);
+  return 0;
+}
+
+/**
+ * @brief Takes the oldest command off the queue, service thread only
+ * 
+ * @param [out] cmd Where to copy the command to
+ * 
+ * @return true if there was a command
+ */
+static bool _led_cmd_pop(led_cmd *cmd) {
+  uint32_t position;
+  if (!led_ring_take(&_led_cmd_ring, &position)) {
+    return false;
+  }
+
+  *cmd = _led_cmds[position % CONFIG_LED_CMD_QUEUE_SIZE];
+  led_ring_free(&_led_cmd_ring);
+  return true;
+}
+
+/**
+ * @brief Carries out one command, service thread only
+ * 
+ * @param [in] cmd The command
+ */
+static void _led_cmd_apply(const led_cmd *cmd) {
+  switch (cmd->type) {
+    case LED_CMD_PWM:
+      _led_halt_blink(cmd->led);
+      _leds[cmd->led].current_duty_cycle = cmd->duty_cycle;
+      _led_pwm_preserve_blink(cmd->led, cmd->duty_cycle);
+      break;
+    case LED_CMD_TOGGLE:
+      _leds[cmd->led].current_duty_cycle = _leds[cmd->led].current_duty_cycle ? 0 : LED_WAVE_MAX;
+      _led_pwm_preserve_blink(cmd->led, _leds[cmd->led].current_duty_cycle);
+      break;
+    case LED_CMD_PLAY:
+      _led_play(cmd->led, &cmd->wave);
+      break;
+    case LED_CMD_STAGE:
+      for (int i = 0; i < NUM_LEDS; i++) {
+        if (cmd->frame.led_mask & BIT(i)) {
+          _led_frame.duty_cycles[i] = cmd->frame.duty_cycles[i];
+        }
+      }
+      _led_frame.led_mask |= cmd->frame.led_mask;
+      break;
+    case LED_CMD_COMMIT:
+      _led_commit();
+      break;
+    case LED_CMD_CARRIER:
+      _led_carrier(cmd->led, cmd->carrier.frequency_hz, cmd->carrier.resolution);
+      break;
+    case LED_CMD_FADE_MANY: {
+      led_wave waves[NUM_LEDS];
+      for (int i = 0; i < NUM_LEDS; i++) {
+        const led_fade *fade = &cmd->fade_many.fades[i];
+        if (0 == fade->duration_ms || fade->from == fade->to) {
+          waves[i] = (led_wave){.type=LED_WAVE_STEADY, .to=led_wave_gamma(fade->to)};
+        } else {
+          waves[i] = (led_wave){
+            .type=LED_WAVE_FADE,
+            .from=fade->from,
+            .to=fade->to,
+            .curve=fade->curve,
+            .period_ms=ROUND_UP(fade->duration_ms, CONFIG_LED_WAVE_STEP_MS),
+          };
+          led_wave_prepare(&waves[i]);
+        }
+      }
+      _led_play_many(cmd->fade_many.led_mask, waves);
+
+      uint32_t latency_us = k_cyc_to_us_floor32(k_cycle_get_32() - cmd->fade_many.queued);
+      k_spinlock_key_t key = k_spin_lock(&_led_latency_lock);
+      _led_latency.count++;
+      _led_latency.last_us = latency_us;
+      _led_latency.max_us = MAX(_led_latency.max_us, latency_us);
+      _led_latency.total_us += latency_us;
+      k_spin_unlock(&_led_latency_lock, key);
+      break;
+    }
+  }
+}
+
+/**
+ * @brief Owns every LED. Carries out queued commands, then sleeps until the next command or the
+ *        next level change of a waveform it plays. Each level change is an absolute timepoint worked
+ *        out from the waveform's start, so late wakeups don't add up
  * 
  * @param [in] p1 Unused thread parameter 1
  * @param [in] p2 Unused thread parameter 2
  * @param [in] p2 Unused thread parameter 3
  */
-static void _led_blink_loop(void *p1 __attribute__((unused)), void *p2 __attribute__((unused)), void *p3 __attribute__((unused))) {
-  uint16_t min_half_period = LED_COUNTER_HALF_PERIOD / LED_16HZ;
-
+static void _led_service_loop(void *p1 __attribute__((unused)), void *p2 __attribute__((unused)), void *p3 __attribute__((unused))) {
   while (1) {
-    k_msleep(min_half_period / LED_COUNTER_UNIT);
+    led_cmd cmd;
+    bool drained = false;
+    while (_led_cmd_pop(&cmd)) {
+      _led_cmd_apply(&cmd);
+      drained = true;
+    }
+    if (drained) {
+      k_sem_give(&_led_service.room); // A waiter that gets in gives wake, so the next one is let in after that drain
+    }
+
+    int64_t now = k_uptime_ticks();
+    int64_t next = INT64_MAX;
 
     for (int i = 0; i < NUM_LEDS; i++) {
-      if (_led_blink_thread.led_bitmask & BIT(i)) {
-        _leds[i]->blink.offset += min_half_period;
-        if (_leds[i]->blink.offset >= _leds[i]->blink.half_period){
-          _leds[i]->blink.offset = 0;
-          LED_toggle(i);
+      if (_led_service.led_bitmask & BIT(i)) {
+        const led_wave *wave = &_leds[i].wave;
+        uint32_t loop_ms = led_wave_loop_ms(wave);
+        uint32_t t_ms = (uint32_t)k_ticks_to_ms_floor64(now - _leds[i].wave_start) - _leds[i].loop_start_ms;
+        // The thread wakes at least once per loop, so this rarely subtracts more than once
+        while (loop_ms && t_ms >= loop_ms) {
+          _leds[i].loop_start_ms += loop_ms;
+          t_ms -= loop_ms;
+        }
+        uint16_t duty_cycle = led_wave_sample(wave, t_ms);
+
+        if (duty_cycle != _leds[i].current_duty_cycle) {
+          _leds[i].current_duty_cycle = duty_cycle;
+          _led_pwm_preserve_blink(i, duty_cycle);
+        }
+
+        uint32_t edge_ms = led_wave_next_ms(wave, t_ms);
+        if (UINT32_MAX == edge_ms) {
+          _led_halt_blink(i); // Finished fade
+        } else {
+          uint64_t since_start_ms = (uint64_t)_leds[i].loop_start_ms + edge_ms;
+          next = MIN(next, _leds[i].wave_start + (int64_t)k_ms_to_ticks_ceil64(since_start_ms));
         }
       }
     }
+
+    k_sem_take(&_led_service.wake, INT64_MAX == next ? K_FOREVER : K_TIMEOUT_ABS_TICKS(next));
   }
 }
 
@@ -135,30 +491,44 @@ static void _led_blink_loop(void *p1 __attribute__((unused)), void *p2 __attribu
                               Public Functions
 ---------------------------------------------------------------------------- */
 /**
- * @brief Inits all LEDs
+ * @brief Inits all LEDs and starts the service thread
  * 
  * @return Error code, < 0 on failures
  */
 int LED_init() {
+  int rv;
+#ifdef CONFIG_LED_HW_SEQUENCER
+  rv = led_seq_init();
+  if (rv < 0) {
+    return rv;
+  }
+#else
   for (int i = 0; i < NUM_LEDS; i++) {
-    int rv = pwm_is_ready_dt(&_leds[i]->spec);
-    if (rv < 0) {
-      return rv;
+    if (!pwm_is_ready_dt(&_led_specs[i])) {
+      return -ENODEV;
     }
+    _leds[i].period = _led_specs[i].period;
+  }
+#endif
+
+  rv = led_ring_init(&_led_cmd_ring, _led_cmd_sequences, CONFIG_LED_CMD_QUEUE_SIZE);
+  if (rv < 0) {
+    return rv;
   }
 
-  _led_blink_thread.id = k_thread_create(
-    &_led_blink_thread.thread,
-    _led_blink_stack,
-    K_THREAD_STACK_SIZEOF(_led_blink_stack),
-    _led_blink_loop,
+  k_sem_init(&_led_service.wake, 0, 1);
+  k_sem_init(&_led_service.room, 0, 1);
+  _led_service.id = k_thread_create(
+    &_led_service.thread,
+    _led_service_stack,
+    K_THREAD_STACK_SIZEOF(_led_service_stack),
+    _led_service_loop,
     NULL, NULL, NULL,
-    LED_BLINK_PRIORITY,
+    LED_SERVICE_PRIORITY,
     0,
     K_NO_WAIT
   );
-  k_thread_suspend(_led_blink_thread.id);
-  
+
   return 0;
 }
 
@@ -167,19 +537,15 @@ int LED_init() {
  * 
  * @param [in] led The LED instance to toggle
  * 
- * @return Error code, < 0 on failures
+ * @return Error code, -EAGAIN if the command queue is full in an ISR
  */
 int LED_toggle(led_id led) {
   if (IS_INVALID_LED(led)) {
     return -EINVAL;
-  } else {
-    if (0 == _leds[led]->current_duty_cycle) {
-      _leds[led]->current_duty_cycle = PWM_MAX_DUTY_CYCLE;
-    } else {
-      _leds[led]->current_duty_cycle = 0;
-    }
-    return _led_pwm_preserve_blink(led, _leds[led]->current_duty_cycle);
   }
+
+  led_cmd cmd = {.type=LED_CMD_TOGGLE, .led=led};
+  return _led_cmd_push(&cmd);
 }
 
 /**
@@ -188,17 +554,10 @@ int LED_toggle(led_id led) {
  * @param [in] led The LED instance to set
  * @param [in] new_state The state to set the led to
  * 
- * @return Error code, < 0 on failures
+ * @return Error code, -EAGAIN if the command queue is full in an ISR
  */
 int LED_set(led_id led, led_state new_state) {
-  if (IS_INVALID_LED(led)) {
-    return -EINVAL;
-  }
-
-  _led_halt_blink(led);
-
-  _leds[led]->current_duty_cycle = (0 == new_state) ? 0 : PWM_MAX_DUTY_CYCLE;
-  return LED_pwm(led, _leds[led]->current_duty_cycle);
+  return LED_pwm(led, (0 == new_state) ? 0 : PWM_MAX_DUTY_CYCLE);
 }
 
 /**
@@ -207,16 +566,40 @@ int LED_set(led_id led, led_state new_state) {
  * @param [in] led The LED instance to set the pwm duty cycle of
  * @param [in] duty_cycle The duty cycle to set the LED to, expects 0 - 100 only
  * 
- * @return Error code, < 0 on failures
+ * @return Error code, -EAGAIN if the command queue is full in an ISR
  */
 int LED_pwm(led_id led, uint8_t duty_cycle) {
   if (IS_INVALID_LED(led)) {
     return -EINVAL;
   }
 
-  _led_halt_blink(led);
+  led_cmd cmd = {
+    .type=LED_CMD_PWM,
+    .led=led,
+    .duty_cycle=PERCENT_TO_LEVEL(duty_cycle),
+  };
+  return _led_cmd_push(&cmd);
+}
+
+/**
+ * @brief Set specified LED to a perceived brightness, gamma corrected through the generated table
+ * 
+ * @param [in] led The LED instance to set
+ * @param [in] brightness Perceived brightness, 0 - UINT16_MAX
+ * 
+ * @return Error code, -EAGAIN if the command queue is full in an ISR
+ */
+int LED_brightness(led_id led, uint16_t brightness) {
+  if (IS_INVALID_LED(led)) {
+    return -EINVAL;
+  }
 
-  return _led_pwm_preserve_blink(led, duty_cycle);
+  led_cmd cmd = {
+    .type=LED_CMD_PWM,
+    .led=led,
+    .duty_cycle=led_wave_gamma(brightness),
+  };
+  return _led_cmd_push(&cmd);
 }
 
 /**
@@ -224,20 +607,242 @@ int LED_pwm(led_id led, uint8_t duty_cycle) {
  * 
  * @param [in] led The LED instance to blink
  * @param [in] frequency The frequency to blink the led at
+ * 
+ * @return Error code, -EAGAIN if the command queue is full in an ISR
  */
-void LED_blink(led_id led, led_frequency frequency) {
+int LED_blink(led_id led, led_frequency frequency) {
+  if (frequency > LED_16HZ || frequency <= 0) {
+    return -EINVAL;
+  }
+
+  return LED_blink_custom(led, 1000 / frequency, PWM_MAX_DUTY_CYCLE / 2);
+}
+
+/**
+ * @brief Blinks the given LED with any period and on-time. With CONFIG_LED_HW_SEQUENCER the PWM peripheral
+ *        plays the blink on its own, patterns that don't fit its sequence table use the service thread
+ * 
+ * @param [in] led The LED instance to blink
+ * @param [in] period_ms Length of one on/off cycle in ms
+ * @param [in] duty_cycle Share of the period the LED is on, 0 - 100
+ * 
+ * @return Error code, -EAGAIN if the command queue is full in an ISR
+ */
+int LED_blink_custom(led_id led, uint32_t period_ms, uint8_t duty_cycle) {
   if (IS_INVALID_LED(led)) {
-    return;
-  } else if (frequency > LED_16HZ || frequency <= 0) {
-    return;
+    return -EINVAL;
+  } else if (0 == period_ms || PWM_MAX_DUTY_CYCLE < duty_cycle) {
+    return -EINVAL;
+  }
+
+  uint32_t on_ms = period_ms * duty_cycle / PWM_MAX_DUTY_CYCLE;
+  if (0 == on_ms || period_ms == on_ms) {
+    return LED_set(led, on_ms ? LED_ON : LED_OFF);
+  }
+
+  led_cmd cmd = {
+    .type=LED_CMD_PLAY,
+    .led=led,
+    .wave={
+      .type=LED_WAVE_BLINK,
+      .from=0,
+      .to=LED_WAVE_MAX,
+      .period_ms=period_ms,
+      .on_ms=on_ms,
+    },
+  };
+  return _led_cmd_push(&cmd);
+}
+
+/**
+ * @brief Fades the given LED from one brightness to another and holds it there. Levels are perceived
+ *        brightness, gamma corrected like LED_brightness(). The duration is rounded up to whole
+ *        CONFIG_LED_WAVE_STEP_MS steps
+ * 
+ * @param [in] led The LED instance to fade
+ * @param [in] from The brightness to start at, 0 - 100
+ * @param [in] to The brightness to end at, 0 - 100
+ * @param [in] duration_ms Length of the fade in ms
+ * @param [in] curve Shape of the ramp
+ * 
+ * @return Error code, -EAGAIN if the command queue is full in an ISR
+ */
+int LED_fade(led_id led, uint8_t from, uint8_t to, uint32_t duration_ms, led_curve curve) {
+  if (IS_INVALID_LED(led)) {
+    return -EINVAL;
+  } else if (PWM_MAX_DUTY_CYCLE < from || PWM_MAX_DUTY_CYCLE < to) {
+    return -EINVAL;
+  }
+
+  if (0 == duration_ms || from == to) {
+    return LED_brightness(led, PERCENT_TO_LEVEL(to));
   }
 
-  _leds[led]->blink.half_period = LED_COUNTER_HALF_PERIOD / frequency;
-  _leds[led]->blink.offset = 0;
+  led_cmd cmd = {
+    .type=LED_CMD_PLAY,
+    .led=led,
+    .wave={
+      .type=LED_WAVE_FADE,
+      .from=PERCENT_TO_LEVEL(from),
+      .to=PERCENT_TO_LEVEL(to),
+      .curve=curve,
+      .period_ms=ROUND_UP(duration_ms, CONFIG_LED_WAVE_STEP_MS),
+    },
+  };
+  led_wave_prepare(&cmd.wave);
+  return _led_cmd_push(&cmd);
+}
 
-  if (!_led_blink_thread.led_bitmask) {
-    k_thread_resume(_led_blink_thread.id);
+/**
+ * @brief Breathes the given LED, ramping from min up to max and back down once per period in perceived
+ *        brightness. The period is rounded up to an even number of CONFIG_LED_WAVE_STEP_MS steps
+ * 
+ * @param [in] led The LED instance to breathe
+ * @param [in] min The brightness at the bottom of each breath, 0 - 100
+ * @param [in] max The brightness at the top of each breath, 0 - 100
+ * @param [in] period_ms Length of one breath in ms
+ * @param [in] curve Shape of both ramps
+ * 
+ * @return Error code, -EAGAIN if the command queue is full in an ISR
+ */
+int LED_breathe(led_id led, uint8_t min, uint8_t max, uint32_t period_ms, led_curve curve) {
+  if (IS_INVALID_LED(led)) {
+    return -EINVAL;
+  } else if (0 == period_ms || PWM_MAX_DUTY_CYCLE < min || PWM_MAX_DUTY_CYCLE < max) {
+    return -EINVAL;
   }
 
-  _led_blink_thread.led_bitmask |= BIT(led);
+  led_cmd cmd = {
+    .type=LED_CMD_PLAY,
+    .led=led,
+    .wave={
+      .type=LED_WAVE_BREATHE,
+      .from=PERCENT_TO_LEVEL(min),
+      .to=PERCENT_TO_LEVEL(max),
+      .curve=curve,
+      .period_ms=ROUND_UP(period_ms, 2 * CONFIG_LED_WAVE_STEP_MS),
+    },
+  };
+  led_wave_prepare(&cmd.wave);
+  return _led_cmd_push(&cmd);
+}
+
+/**
+ * @brief Stages duty cycles for any set of LEDs, nothing changes until LED_commit(). Staging an LED
+ *        twice before a commit keeps the latest duty cycle
+ * 
+ * @param [in] led_mask BIT(led) for every LED to stage
+ * @param [in] duty_cycles Duty cycle per LED, indexed by led_id, only entries in led_mask are read
+ * 
+ * @return Error code, -EAGAIN if the command queue is full in an ISR
+ */
+int LED_set_many(uint32_t led_mask, const uint8_t duty_cycles[NUM_LEDS]) {
+  if (IS_INVALID_MASK(led_mask) || NULL == duty_cycles) {
+    return -EINVAL;
+  }
+
+  led_cmd cmd = {.type=LED_CMD_STAGE, .frame={.led_mask=led_mask}};
+  for (int i = 0; i < NUM_LEDS; i++) {
+    if (led_mask & BIT(i)) {
+      cmd.frame.duty_cycles[i] = PERCENT_TO_LEVEL(duty_cycles[i]);
+    }
+  }
+  return _led_cmd_push(&cmd);
+}
+
+/**
+ * @brief Loads every staged duty cycle, halting blinking on those LEDs. With CONFIG_LED_HW_SEQUENCER
+ *        LEDs that are steady already are patched into the playing sequence table, so waveforms on
+ *        the other LEDs don't restart, anything else is rendered into one new table and switches in
+ *        the same PWM period. The Zephyr PWM path applies them back to back. Threads never see a
+ *        half frame, an ISR that gets -EAGAIN keeps its frame staged and retries the commit
+ * 
+ * @return Error code, -EAGAIN if the command queue is full in an ISR
+ */
+int LED_commit() {
+  led_cmd cmd = {.type=LED_CMD_COMMIT};
+  return _led_cmd_push(&cmd);
+}
+
+/**
+ * @brief Fades or sets several LEDs as one frame. The whole frame is a single queued command, so
+ *        nothing else lands between its LEDs. With CONFIG_LED_HW_SEQUENCER every LED in the frame
+ *        changes in the same PWM period, the Zephyr PWM path applies them back to back
+ * 
+ * @param [in] led_mask BIT(led) for every LED in the frame
+ * @param [in] fades Fade per LED, indexed by led_id, only entries in led_mask are read
+ * 
+ * @return Error code, -EAGAIN if the command queue is full in an ISR
+ */
+int LED_fade_many(uint32_t led_mask, const led_fade fades[NUM_LEDS]) {
+  if (IS_INVALID_MASK(led_mask) || NULL == fades) {
+    return -EINVAL;
+  }
+
+  led_cmd cmd = {.type=LED_CMD_FADE_MANY, .fade_many={.led_mask=led_mask}};
+  for (int i = 0; i < NUM_LEDS; i++) {
+    if (led_mask & BIT(i)) {
+      if (LED_CURVE_EASE_IN_OUT < fades[i].curve) {
+        return -EINVAL;
+      }
+      cmd.fade_many.fades[i] = fades[i];
+    }
+  }
+  cmd.fade_many.queued = k_cycle_get_32();
+  return _led_cmd_push(&cmd);
+}
+
+/**
+ * @brief Changes the PWM carrier of the given LED. LEDs on the same PWM instance share a prescaler
+ *        and counter top, so they all move to the new carrier. Devicetree sets the carrier at boot
+ *        through the period cell of pwms and resolution-steps
+ * 
+ * @param [in] led The LED instance
+ * @param [in] frequency_hz Carrier frequency
+ * @param [in] resolution Minimum brightness steps per carrier period
+ * 
+ * @return Error code, -ERANGE if the PWM clock can't reach that resolution at that frequency,
+ *         -EAGAIN if the command queue is full in an ISR
+ */
+int LED_carrier(led_id led, uint32_t frequency_hz, uint16_t resolution) {
+  if (IS_INVALID_LED(led) || 0 == frequency_hz) {
+    return -EINVAL;
+  }
+
+#ifdef CONFIG_LED_HW_SEQUENCER
+  int rv = led_seq_carrier_check(frequency_hz, resolution);
+  if (rv < 0) {
+    return rv;
+  }
+#else
+  uint64_t cycles_per_sec;
+  int rv = pwm_get_cycles_per_sec(_led_specs[led].dev, _led_specs[led].channel, &cycles_per_sec);
+  if (rv < 0) {
+    return rv;
+  } else if (cycles_per_sec / frequency_hz < resolution) {
+    return -ERANGE;
+  }
+#endif
+
+  led_cmd cmd = {
+    .type=LED_CMD_CARRIER,
+    .led=led,
+    .carrier={.frequency_hz=frequency_hz, .resolution=resolution},
+  };
+  return _led_cmd_push(&cmd);
+}
+
+/**
+ * @brief Gets the frame latency of LED_fade_many(), from queueing the frame to the service thread
+ *        loading it into the PWM
+ * 
+ * @param [out] stats Filled with a snapshot of the latency statistics
+ */
+void LED_latency_get(led_latency *stats) {
+  if (NULL == stats) {
+    return;
+  }
+  k_spinlock_key_t key = k_spin_lock(&_led_latency_lock);
+  *stats = _led_latency;
+  k_spin_unlock(&_led_latency_lock, key);
 }
@@ -0,0 +1,123 @@
+/*
+Header to define the bounded multi-producer single-consumer ring behind the led command queue.
+The ring only hands out positions, the caller keeps the items in its own array indexed by
+position & (size - 1). Producers claim a position with one CAS and never block, so claiming
+and publishing is safe from any thread or ISR. Taking and freeing belong to one consumer
+*/
+
+#ifndef LED_RING_H
+#define LED_RING_H
+
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* ----------------------------------------------------------------------------
+                                    TYPES
+---------------------------------------------------------------------------- */
+typedef struct led_ring_t {
+  atomic_t *sequences; // One per item, equals the position while free, position + 1 once published
+  uint32_t mask; // Size - 1
+  atomic_t head; // Next position a producer claims
+  uint32_t tail; // Next position the consumer takes, consumer only
+} led_ring;
+
+/* ----------------------------------------------------------------------------
+                              Function Definitions
+---------------------------------------------------------------------------- */
+/**
+ * @brief Sets up an empty ring, before any producer or consumer uses it
+ *
+ * @param [in] ring The ring
+ * @param [in] sequences One per item
+ * @param [in] size Number of items, a power of two
+ *
+ * @return Error code, -EINVAL if size isn't a power of two
+ */
+static inline int led_ring_init(led_ring *ring, atomic_t *sequences, uint32_t size) {
+  if (0 == size || !IS_POWER_OF_TWO(size)) {
+    return -EINVAL;
+  }
+
+  for (uint32_t i = 0; i < size; i++) {
+    atomic_set(&sequences[i], i);
+  }
+  ring->sequences = sequences;
+  ring->mask = size - 1;
+  atomic_set(&ring->head, 0);
+  ring->tail = 0;
+  return 0;
+}
+
+/**
+ * @brief Claims the next position for one item. Only retries when another producer claimed the
+ *        same position first
+ *
+ * @param [in] ring The ring
+ * @param [out] position The claimed position, write the item then call led_ring_publish()
+ *
+ * @return Error code, -EAGAIN if the ring is full
+ */
+static inline int led_ring_claim(led_ring *ring, uint32_t *position) {
+  uint32_t claim = atomic_get(&ring->head);
+
+  while (1) {
+    int32_t lag = (int32_t)((uint32_t)atomic_get(&ring->sequences[claim & ring->mask]) - claim);
+
+    if (0 == lag) {
+      if (atomic_cas(&ring->head, claim, claim + 1)) {
+        break;
+      }
+    } else if (lag < 0) {
+      return -EAGAIN; // The consumer hasn't freed this item from the previous lap yet
+    }
+    claim = atomic_get(&ring->head);
+  }
+
+  *position = claim;
+  return 0;
+}
+
+/**
+ * @brief Hands a claimed and written item to the consumer
+ *
+ * @param [in] ring The ring
+ * @param [in] position From led_ring_claim()
+ */
+static inline void led_ring_publish(led_ring *ring, uint32_t position) {
+  atomic_set(&ring->sequences[position & ring->mask], position + 1);
+}
+
+/**
+ * @brief Finds the oldest item, consumer only. Items are taken in claim order, a claimed item that
+ *        isn't published yet holds back the ones claimed after it
+ *
+ * @param [in] ring The ring
+ * @param [out] position Position of the oldest item, read it then call led_ring_free()
+ *
+ * @return true if the oldest item is published
+ */
+static inline bool led_ring_take(led_ring *ring, uint32_t *position) {
+  uint32_t tail = ring->tail;
+  if ((int32_t)((uint32_t)atomic_get(&ring->sequences[tail & ring->mask]) - (tail + 1)) < 0) {
+    return false;
+  }
+
+  *position = tail;
+  return true;
+}
+
+/**
+ * @brief Gives the item from led_ring_take() back to the producers, consumer only
+ *
+ * @param [in] ring The ring
+ */
+static inline void led_ring_free(led_ring *ring) {
+  uint32_t tail = ring->tail;
+  atomic_set(&ring->sequences[tail & ring->mask], tail + ring->mask + 1);
+  ring->tail = tail + 1;
+}
+
+#endif
\ No newline at end of file
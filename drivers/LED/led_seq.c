@@ -0,0 +1,694 @@
+/*
+nRF PWM sequencer backend of the led module. Every LED's waveform is rendered into one
+RAM table that the PWM peripheral loops through EasyDMA without any CPU involvement.
+A new table takes over at the end of a loop of the playing one, the PWM never stops, so
+the LEDs that didn't change carry on in phase
+*/
+
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/pinctrl.h>
+#include <zephyr/dt-bindings/pwm/pwm.h>
+#include <nrfx_pwm.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "LED.h"
+#include "led_seq.h"
+#include "led_wave.h"
+
+/* ----------------------------------------------------------------------------
+                                    Constants
+---------------------------------------------------------------------------- */
+#define SEQ_BASE_CLOCK_HZ     16000000 // Before the prescaler
+#define SEQ_MAX_PRESCALER     7 // NRF_PWM_CLK_125kHz
+#define SEQ_MAX_COUNTERTOP    32767 // 15 bit COUNTERTOP register
+#define SEQ_POLARITY_NORMAL   BIT(15) // Output is high for the first compare counts of each period
+#define SEQ_TABLES            3 // The PWM's two sequences can hold two tables while one takes over, plus one to render
+#define SEQ_END_INTS          (NRF_PWM_INT_SEQEND0_MASK | NRF_PWM_INT_SEQEND1_MASK)
+#define SEQ_PLAYBACK_FLAGS    (NRFX_PWM_FLAG_LOOP | NRFX_PWM_FLAG_SIGNAL_END_SEQ0 | NRFX_PWM_FLAG_SIGNAL_END_SEQ1 | \
+                               NRFX_PWM_FLAG_NO_EVT_FINISHED)
+
+/* ----------------------------------------------------------------------------
+                                  Macro Helpers
+---------------------------------------------------------------------------- */
+#define LED_PWM_NODE          DT_NODELABEL(UTIL_CAT(pwm, CONFIG_LED_PWM_INSTANCE))
+
+#define IS_INVALID_LED(led)   (led >= NUM_LEDS || led < 0)
+#define IS_INVALID_MASK(mask) ((mask) & ~LED_MASK_ALL)
+#define IS_INVALID_WAVE(wave) (LED_WAVE_STEADY != (wave)->type && 0 == (wave)->period_ms)
+
+#define SEQ_PIN_INIT(node) { \
+  .channel=DT_PWMS_CHANNEL(node), \
+  .inverted=(DT_PWMS_FLAGS(node) & PWM_POLARITY_INVERTED) != 0, \
+}
+
+// Every LED shares one carrier, so each one equals the mean and the mean is the carrier
+#define SEQ_PERIOD_SUM        ((uint64_t)DT_FOREACH_CHILD_STATUS_OKAY_SEP(LED_NODE, DT_PWMS_PERIOD, (+)))
+#define SEQ_RESOLUTION_OF(node) DT_PROP(node, resolution_steps)
+#define SEQ_RESOLUTION_SUM    ((uint64_t)DT_FOREACH_CHILD_STATUS_OKAY_SEP(LED_NODE, SEQ_RESOLUTION_OF, (+)))
+
+#define SEQ_PERIOD_HZ         (NSEC_PER_SEC / (SEQ_PERIOD_SUM / NUM_LEDS))
+#define SEQ_RESOLUTION        (SEQ_RESOLUTION_SUM / NUM_LEDS)
+
+#define SEQ_ON_INSTANCE(node) DT_SAME_NODE(LED_PWM_NODE, DT_PWMS_CTLR(node))
+// The sums come in as arguments, a FOREACH can't expand inside its own callback
+#define SEQ_SAME_CARRIER(node, period_sum, resolution_sum) \
+  (DT_PWMS_PERIOD(node) * (uint64_t)NUM_LEDS == (period_sum) && \
+   SEQ_RESOLUTION_OF(node) * (uint64_t)NUM_LEDS == (resolution_sum))
+
+BUILD_ASSERT(NUM_LEDS <= NRF_PWM_CHANNEL_COUNT, "One PWM instance drives at most NRF_PWM_CHANNEL_COUNT LEDs");
+BUILD_ASSERT(DT_FOREACH_CHILD_STATUS_OKAY_SEP(LED_NODE, SEQ_ON_INSTANCE, (&&)),
+             "Every LED has to be on the CONFIG_LED_PWM_INSTANCE controller");
+BUILD_ASSERT(DT_FOREACH_CHILD_STATUS_OKAY_SEP_VARGS(LED_NODE, SEQ_SAME_CARRIER, (&&), SEQ_PERIOD_SUM, SEQ_RESOLUTION_SUM),
+             "Channels of one PWM instance share its prescaler and counter top, give every LED the same carrier");
+
+/* ----------------------------------------------------------------------------
+                                    Types
+---------------------------------------------------------------------------- */
+typedef struct seq_pin_t {
+  uint8_t channel; // PWM channel from devicetree
+  bool inverted;
+} seq_pin;
+
+typedef struct seq_channel_t {
+  led_wave wave;
+  uint32_t phase_ms; // Where in its loop the waveform is when the table starts
+} seq_channel;
+
+typedef struct seq_table_t {
+  uint16_t values[CONFIG_LED_SEQ_MAX_STEPS][NRF_PWM_CHANNEL_COUNT];
+  nrf_pwm_sequence_t seq; // Points into values, what the PWM loads
+  seq_channel channels[NUM_LEDS]; // Every LED as the table starts
+  uint32_t fade_ms; // Longest fade ramp, 0 without fades
+} seq_table;
+
+/* ----------------------------------------------------------------------------
+                            Private Function Prototypes
+---------------------------------------------------------------------------- */
+static uint16_t _seq_value(led_id led, uint16_t duty_cycle);
+
+static int _seq_pick_clock(uint32_t frequency_hz, uint16_t resolution, nrf_pwm_clk_t *clock, uint16_t *top);
+
+static void _seq_config(nrfx_pwm_config_t *config, nrf_pwm_clk_t clock, uint16_t top);
+
+static void _seq_carry(seq_channel channels[NUM_LEDS]);
+
+static int _seq_render(seq_table *table, const seq_channel channels[NUM_LEDS]);
+
+static void _seq_switch(uint8_t table);
+
+static void _seq_start(uint8_t table);
+
+static void _seq_handler(nrfx_pwm_evt_type_t type, void *context);
+
+static bool _seq_patchable(const seq_table *table, uint32_t led_mask, const led_wave waves[NUM_LEDS]);
+
+static void _seq_patch(seq_table *table, uint32_t led_mask, const led_wave waves[NUM_LEDS]);
+
+static void _seq_fade_done(struct k_work *work);
+
+/* ----------------------------------------------------------------------------
+                                Global States
+---------------------------------------------------------------------------- */
+PINCTRL_DT_DEFINE(LED_PWM_NODE);
+
+static const nrfx_pwm_t _seq_pwm = NRFX_PWM_INSTANCE(CONFIG_LED_PWM_INSTANCE);
+
+static const seq_pin _seq_pins[NUM_LEDS] = {
+  DT_FOREACH_CHILD_STATUS_OKAY_SEP(LED_NODE, SEQ_PIN_INIT, (,))
+};
+
+// Zeroed, every LED starts steady and off
+static seq_table _seq_tables[SEQ_TABLES];
+static uint8_t _seq_latest = 0; // Last table rendered, the next render starts from its channels
+static uint16_t _seq_top = 0; // Counter top of the running carrier, full scale of every compare value
+static uint32_t _seq_carrier_hz = 0; // Actual carrier after rounding to the prescaler and counter top
+
+// Shared with the PWM interrupt under _seq_switch_lock
+static uint8_t _seq_installed[2]; // Table in each of the PWM's two sequences, they play in turn
+static int8_t _seq_next = -1; // Table to load into each sequence as it ends, -1 when none is waiting
+static int8_t _seq_fading = -1; // Table whose fades _seq_fade_work retires
+static bool _seq_armed = false; // Sequence end interrupts are on
+
+K_MUTEX_DEFINE(_seq_lock);
+static struct k_spinlock _seq_switch_lock;
+K_WORK_DELAYABLE_DEFINE(_seq_fade_work, _seq_fade_done);
+
+/* ----------------------------------------------------------------------------
+                              Private Functions
+---------------------------------------------------------------------------- */
+/**
+ * @brief Converts a duty cycle to a sequence value, LEDs are active low like the Zephyr PWM path
+ * 
+ * @param [in] led The LED the value is for
+ * @param [in] duty_cycle The duty cycle, 0 - LED_WAVE_MAX
+ * 
+ * @return Compare value with the channel's polarity bit
+ */
+static uint16_t _seq_value(led_id led, uint16_t duty_cycle) {
+  uint16_t pulse = led_wave_scale(_seq_top, LED_WAVE_MAX - duty_cycle);
+  return _seq_pins[led].inverted ? pulse : (pulse | SEQ_POLARITY_NORMAL);
+}
+
+/**
+ * @brief Picks the prescaler and counter top closest to a carrier frequency that still give at
+ *        least the requested brightness steps per period. Ties go to the faster clock, which
+ *        has the larger counter top and so the finer steps
+ * 
+ * @param [in] frequency_hz Requested carrier frequency
+ * @param [in] resolution Minimum brightness steps per period
+ * @param [out] clock The prescaled PWM clock
+ * @param [out] top The counter top
+ * 
+ * @return Error code, -ERANGE if no pair reaches the resolution at that frequency
+ */
+static int _seq_pick_clock(uint32_t frequency_hz, uint16_t resolution, nrf_pwm_clk_t *clock, uint16_t *top) {
+  uint32_t best_error = UINT32_MAX;
+
+  for (int prescaler = 0; prescaler <= SEQ_MAX_PRESCALER; prescaler++) {
+    uint32_t clock_hz = SEQ_BASE_CLOCK_HZ >> prescaler;
+    uint32_t candidate = DIV_ROUND_CLOSEST(clock_hz, frequency_hz);
+    if (candidate > SEQ_MAX_COUNTERTOP) {
+      continue; // Clock too fast for this carrier, try a slower one
+    } else if (candidate < resolution || candidate < 3) {
+      break; // Only gets coarser from here
+    }
+
+    uint32_t actual_hz = clock_hz / candidate;
+    uint32_t error = actual_hz > frequency_hz ? actual_hz - frequency_hz : frequency_hz - actual_hz;
+    if (error < best_error) {
+      best_error = error;
+      *clock = (nrf_pwm_clk_t)prescaler;
+      *top = candidate;
+    }
+  }
+  return UINT32_MAX == best_error ? -ERANGE : 0;
+}
+
+/**
+ * @brief Fills in the nrfx configuration for a carrier
+ * 
+ * @param [out] config The configuration to fill in
+ * @param [in] clock The prescaled PWM clock
+ * @param [in] top The counter top
+ */
+static void _seq_config(nrfx_pwm_config_t *config, nrf_pwm_clk_t clock, uint16_t top) {
+  *config = (nrfx_pwm_config_t){
+    .output_pins = {
+      NRF_PWM_PIN_NOT_CONNECTED,
+      NRF_PWM_PIN_NOT_CONNECTED,
+      NRF_PWM_PIN_NOT_CONNECTED,
+      NRF_PWM_PIN_NOT_CONNECTED,
+    },
+    .irq_priority = DT_IRQ(LED_PWM_NODE, priority),
+    .base_clock = clock,
+    .count_mode = NRF_PWM_MODE_UP,
+    .top_value = top,
+    .load_mode = NRF_PWM_LOAD_INDIVIDUAL,
+    .step_mode = NRF_PWM_STEP_AUTO,
+    .skip_gpio_cfg = true, // Pins come from pinctrl
+    .skip_psel_cfg = true,
+  };
+}
+
+/**
+ * @brief Turns the channels a table starts with into the ones the table after it starts with. Tables
+ *        take over at the end of a loop, where every blink and breath is back at the phase it
+ *        started the loop with. A loop is at least twice the longest fade, so fades are done by then
+ * 
+ * @param [in,out] channels Every LED, indexed by led_id
+ */
+static void _seq_carry(seq_channel channels[NUM_LEDS]) {
+  for (int i = 0; i < NUM_LEDS; i++) {
+    if (LED_WAVE_FADE == channels[i].wave.type) {
+      channels[i].wave = (led_wave){
+        .type=LED_WAVE_STEADY,
+        .to=led_wave_sample(&channels[i].wave, channels[i].wave.period_ms),
+      };
+      channels[i].phase_ms = 0;
+    }
+  }
+}
+
+/**
+ * @brief Renders the channels into a table that no sequence of the PWM holds. The table covers the
+ *        least common multiple of all waveform loops, sampled at the largest step that still hits
+ *        every level change. Each step is held for as many carrier periods as fit in it with the
+ *        sequence refresh count. Phases are kept to the ms, a channel whose phase falls between two
+ *        steps is sampled from the nearest one, so its edges are at most half a step off and the
+ *        error never adds up over re-renders. Expects _seq_lock to be held
+ * 
+ * @param [out] table The table to render into, untouched on failures
+ * @param [in] channels Every LED as the table starts, indexed by led_id
+ * 
+ * @return Error code, -ENOMEM if the patterns don't fit CONFIG_LED_SEQ_MAX_STEPS
+ */
+static int _seq_render(seq_table *table, const seq_channel channels[NUM_LEDS]) {
+  uint64_t period_ms = 1;
+  uint32_t step_ms = 0;
+  uint32_t fade_ms = 0;
+
+  for (int i = 0; i < NUM_LEDS; i++) {
+    const seq_channel *ch = &channels[i];
+    uint32_t loop_ms = led_wave_loop_ms(&ch->wave);
+    if (loop_ms) {
+      period_ms = period_ms / led_wave_gcd(period_ms, loop_ms) * loop_ms;
+      if (period_ms > UINT32_MAX) {
+        return -ENOMEM;
+      }
+      step_ms = led_wave_gcd(step_ms, led_wave_grid_ms(&ch->wave));
+    }
+    if (LED_WAVE_FADE == ch->wave.type) {
+      fade_ms = MAX(fade_ms, ch->wave.period_ms - ch->phase_ms);
+    }
+  }
+  if (0 == step_ms) {
+    step_ms = 1; // Everything steady, a single step does
+  }
+
+  uint64_t steps = period_ms / step_ms;
+  uint32_t step_periods = MAX(DIV_ROUND_CLOSEST((uint64_t)step_ms * _seq_carrier_hz, MSEC_PER_SEC), 1);
+  if (steps > CONFIG_LED_SEQ_MAX_STEPS) {
+    return -ENOMEM;
+  }
+
+  for (int c = 0; c < NRF_PWM_CHANNEL_COUNT; c++) {
+    for (uint32_t s = 0; s < steps; s++) {
+      table->values[s][c] = 0;
+    }
+  }
+  for (int i = 0; i < NUM_LEDS; i++) {
+    const seq_channel *ch = &channels[i];
+    uint32_t loop_ms = led_wave_loop_ms(&ch->wave);
+    // Sampled from the step nearest to the phase, the phase itself stays exact
+    uint32_t t = ch->phase_ms + step_ms / 2;
+    t = loop_ms ? (t - t % step_ms) % loop_ms : 0;
+    for (uint32_t s = 0; s < steps; s++) {
+      table->values[s][_seq_pins[i].channel] = _seq_value(i, led_wave_sample(&ch->wave, t));
+      t += step_ms;
+      if (loop_ms && t >= loop_ms) {
+        t -= loop_ms;
+      }
+    }
+    table->channels[i] = *ch;
+  }
+
+  table->seq = (nrf_pwm_sequence_t){
+    .values.p_raw = &table->values[0][0],
+    .length = steps * NRF_PWM_CHANNEL_COUNT,
+    .repeats = step_periods - 1, // Refresh count, each step plays for step_periods periods
+    .end_delay = 0,
+  };
+  table->fade_ms = fade_ms;
+  return 0;
+}
+
+/**
+ * @brief Hands a rendered table to the PWM interrupt, which loads it into each of the two sequences
+ *        as that one ends. It plays from the end of the loop after the first load. A table that is
+ *        waiting and not loaded yet is replaced. Expects _seq_lock to be held
+ * 
+ * @param [in] table Index of the table
+ */
+static void _seq_switch(uint8_t table) {
+  k_spinlock_key_t key = k_spin_lock(&_seq_switch_lock);
+  _seq_next = table;
+  if (!_seq_armed) {
+    // The events kept coming while the interrupts were off, only the next one means a sequence just ended
+    nrf_pwm_event_clear(_seq_pwm.p_reg, NRF_PWM_EVENT_SEQEND0);
+    nrf_pwm_event_clear(_seq_pwm.p_reg, NRF_PWM_EVENT_SEQEND1);
+    nrf_pwm_int_enable(_seq_pwm.p_reg, SEQ_END_INTS);
+    _seq_armed = true;
+  }
+  k_spin_unlock(&_seq_switch_lock, key);
+}
+
+/**
+ * @brief Starts looping a table from its first step, dropping any table that was waiting. Only for
+ *        a stopped PWM. Expects _seq_lock to be held
+ * 
+ * @param [in] table Index of the table
+ */
+static void _seq_start(uint8_t table) {
+  k_spinlock_key_t key = k_spin_lock(&_seq_switch_lock);
+  _seq_installed[0] = table;
+  _seq_installed[1] = table;
+  _seq_next = -1;
+  _seq_fading = -1;
+  nrfx_pwm_complex_playback(&_seq_pwm, &_seq_tables[table].seq, &_seq_tables[table].seq, 1, SEQ_PLAYBACK_FLAGS);
+  // Nothing to switch to, the sequence end interrupts only come on for the next switch
+  nrf_pwm_int_disable(_seq_pwm.p_reg, SEQ_END_INTS);
+  _seq_armed = false;
+  k_spin_unlock(&_seq_switch_lock, key);
+
+  _seq_latest = table;
+}
+
+/**
+ * @brief Sequence end interrupt, only on while a switch is under way. The sequence that ended stays
+ *        idle until the other one ends, so the waiting table is loaded into it then. Once both hold
+ *        it the interrupts go off again
+ * 
+ * @param [in] type Which sequence ended
+ * @param [in] context Unused
+ */
+static void _seq_handler(nrfx_pwm_evt_type_t type, void *context __attribute__((unused))) {
+  if (NRFX_PWM_EVT_END_SEQ0 != type && NRFX_PWM_EVT_END_SEQ1 != type) {
+    return;
+  }
+  uint8_t ended = NRFX_PWM_EVT_END_SEQ0 == type ? 0 : 1;
+
+  k_spinlock_key_t key = k_spin_lock(&_seq_switch_lock);
+  uint8_t starting = _seq_installed[!ended];
+  if (starting != _seq_installed[ended] && _seq_tables[starting].fade_ms) {
+    // First loop of a table with fades, they have to turn steady before it wraps around
+    _seq_fading = starting;
+    k_work_reschedule(&_seq_fade_work, K_MSEC(_seq_tables[starting].fade_ms));
+  }
+
+  if (_seq_next >= 0) {
+    nrfx_pwm_sequence_update(&_seq_pwm, ended, &_seq_tables[_seq_next].seq);
+    _seq_installed[ended] = _seq_next;
+  }
+  if (_seq_next < 0 || _seq_installed[!ended] == _seq_next) {
+    _seq_next = -1;
+    nrf_pwm_int_disable(_seq_pwm.p_reg, SEQ_END_INTS);
+    _seq_armed = false;
+  }
+  k_spin_unlock(&_seq_switch_lock, key);
+}
+
+/**
+ * @brief Checks a set of waveforms can be patched into a table. That takes every one of them to be
+ *        steady over an LED that is steady already, nothing else moves then
+ * 
+ * @param [in] table The table
+ * @param [in] led_mask BIT(led) for every LED to check
+ * @param [in] waves Waveform per LED, indexed by led_id, only entries in led_mask are read
+ * 
+ * @return true if _seq_patch() can load them
+ */
+static bool _seq_patchable(const seq_table *table, uint32_t led_mask, const led_wave waves[NUM_LEDS]) {
+  for (int i = 0; i < NUM_LEDS; i++) {
+    if ((led_mask & BIT(i)) &&
+        (LED_WAVE_STEADY != waves[i].type || LED_WAVE_STEADY != table->channels[i].wave.type)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Rewrites the columns of steady LEDs in a playing table, EasyDMA picks the new values up
+ *        the next time it fetches each step. The PWM keeps running, so every other LED carries on
+ *        in phase. A step's channels are written back to back, the frame can only tear if the PWM
+ *        fetches that very step in between, and then only until its next fetch. Expects _seq_lock
+ *        to be held
+ * 
+ * @param [in] table The table
+ * @param [in] led_mask BIT(led) for every LED to set, _seq_patchable() must have passed
+ * @param [in] waves Waveform per LED, indexed by led_id, only entries in led_mask are read
+ */
+static void _seq_patch(seq_table *table, uint32_t led_mask, const led_wave waves[NUM_LEDS]) {
+  uint16_t values[NUM_LEDS];
+  uint32_t steps = table->seq.length / NRF_PWM_CHANNEL_COUNT;
+
+  for (int i = 0; i < NUM_LEDS; i++) {
+    if (led_mask & BIT(i)) {
+      table->channels[i].wave = waves[i];
+      values[i] = _seq_value(i, waves[i].to);
+    }
+  }
+  for (uint32_t s = 0; s < steps; s++) {
+    for (int i = 0; i < NUM_LEDS; i++) {
+      if (led_mask & BIT(i)) {
+        table->values[s][_seq_pins[i].channel] = values[i];
+      }
+    }
+  }
+}
+
+/**
+ * @brief Patches finished fades into steady LEDs while their table plays the hold after the ramp,
+ *        so the ramp doesn't start over when the table wraps around
+ * 
+ * @param [in] work Unused work item
+ */
+static void _seq_fade_done(struct k_work *work __attribute__((unused))) {
+  k_mutex_lock(&_seq_lock, K_FOREVER);
+  k_spinlock_key_t key = k_spin_lock(&_seq_switch_lock);
+  int8_t fading = _seq_fading;
+  // A table no sequence holds any more may be rendered over already
+  bool held = fading >= 0 && (fading == _seq_installed[0] || fading == _seq_installed[1]);
+  _seq_fading = -1;
+  k_spin_unlock(&_seq_switch_lock, key);
+
+  if (held) {
+    seq_table *table = &_seq_tables[fading];
+    seq_channel steady[NUM_LEDS];
+    led_wave waves[NUM_LEDS];
+    uint32_t led_mask = 0;
+
+    memcpy(steady, table->channels, sizeof(steady));
+    _seq_carry(steady);
+    for (int i = 0; i < NUM_LEDS; i++) {
+      waves[i] = steady[i].wave;
+      if (LED_WAVE_FADE == table->channels[i].wave.type) {
+        led_mask |= BIT(i);
+      }
+    }
+    _seq_patch(table, led_mask, waves);
+    table->fade_ms = 0;
+  }
+  k_mutex_unlock(&_seq_lock);
+}
+
+/* ----------------------------------------------------------------------------
+                              Backend Functions
+---------------------------------------------------------------------------- */
+/**
+ * @brief Takes over the PWM instance and starts playing with every LED off
+ * 
+ * @return Error code, < 0 on failures
+ */
+int led_seq_init() {
+  int rv = pinctrl_apply_state(PINCTRL_DT_DEV_CONFIG_GET(LED_PWM_NODE), PINCTRL_STATE_DEFAULT);
+  if (rv < 0) {
+    return rv;
+  }
+
+  nrf_pwm_clk_t clock;
+  rv = _seq_pick_clock(SEQ_PERIOD_HZ, SEQ_RESOLUTION, &clock, &_seq_top);
+  if (rv < 0) {
+    return rv;
+  }
+  _seq_carrier_hz = (SEQ_BASE_CLOCK_HZ >> clock) / _seq_top;
+
+  IRQ_CONNECT(DT_IRQN(LED_PWM_NODE), DT_IRQ(LED_PWM_NODE, priority), nrfx_isr,
+              NRFX_CONCAT_3(nrfx_pwm_, CONFIG_LED_PWM_INSTANCE, _irq_handler), 0);
+
+  nrfx_pwm_config_t config;
+  _seq_config(&config, clock, _seq_top);
+  if (NRFX_SUCCESS != nrfx_pwm_init(&_seq_pwm, &config, _seq_handler, NULL)) {
+    return -EIO;
+  }
+
+  k_mutex_lock(&_seq_lock, K_FOREVER);
+  rv = _seq_render(&_seq_tables[0], _seq_tables[0].channels);
+  if (0 == rv) {
+    _seq_start(0);
+  }
+  k_mutex_unlock(&_seq_lock);
+  return rv;
+}
+
+/**
+ * @brief Checks a carrier can be reached without changing anything
+ * 
+ * @param [in] frequency_hz Requested carrier frequency
+ * @param [in] resolution Minimum brightness steps per period
+ * 
+ * @return Error code, -ERANGE if the pair can't be reached
+ */
+int led_seq_carrier_check(uint32_t frequency_hz, uint16_t resolution) {
+  nrf_pwm_clk_t clock;
+  uint16_t top;
+  return 0 == frequency_hz ? -EINVAL : _seq_pick_clock(frequency_hz, resolution, &clock, &top);
+}
+
+/**
+ * @brief Changes the carrier of every LED. The channels share one prescaler and counter top, so
+ *        there is no per-LED carrier on the sequencer. The PWM has to stop for a new prescaler, so
+ *        the latest table starts over at the new carrier, with its fades already done
+ * 
+ * @param [in] frequency_hz Requested carrier frequency
+ * @param [in] resolution Minimum brightness steps per period
+ * 
+ * @return Error code, -ERANGE if the pair can't be reached
+ */
+int led_seq_carrier(uint32_t frequency_hz, uint16_t resolution) {
+  if (0 == frequency_hz) {
+    return -EINVAL;
+  }
+
+  nrf_pwm_clk_t clock;
+  uint16_t top;
+  int rv = _seq_pick_clock(frequency_hz, resolution, &clock, &top);
+  if (rv < 0) {
+    return rv;
+  }
+
+  nrfx_pwm_config_t config;
+  _seq_config(&config, clock, top);
+
+  k_mutex_lock(&_seq_lock, K_FOREVER);
+  seq_channel channels[NUM_LEDS];
+  memcpy(channels, _seq_tables[_seq_latest].channels, sizeof(channels));
+  _seq_carry(channels);
+
+  nrfx_pwm_stop(&_seq_pwm, true);
+  k_work_cancel_delayable(&_seq_fade_work);
+  if (NRFX_SUCCESS != nrfx_pwm_reconfigure(&_seq_pwm, &config)) {
+    rv = -EIO;
+  } else {
+    _seq_top = top;
+    _seq_carrier_hz = (SEQ_BASE_CLOCK_HZ >> clock) / top;
+  }
+  // Compare values scale with the counter top, every channel has to be rendered again. The
+  // table is no longer than before, so it always fits
+  uint8_t table = (_seq_latest + 1) % SEQ_TABLES;
+  int err = _seq_render(&_seq_tables[table], channels);
+  _seq_start(table);
+  k_mutex_unlock(&_seq_lock);
+  return rv < 0 ? rv : err;
+}
+
+/**
+ * @brief Holds an LED at a steady duty cycle. Updating an LED that is already steady only rewrites
+ *        its column of the playing table, the other LEDs don't restart
+ * 
+ * @param [in] led The LED to set
+ * @param [in] duty_cycle The duty cycle, 0 - LED_WAVE_MAX
+ * 
+ * @return Error code, < 0 on failures
+ */
+int led_seq_set(led_id led, uint16_t duty_cycle) {
+  if (IS_INVALID_LED(led)) {
+    return -EINVAL;
+  }
+
+  led_wave steady = {.type=LED_WAVE_STEADY, .to=duty_cycle};
+  return led_seq_play(led, &steady);
+}
+
+/**
+ * @brief Holds several LEDs at steady duty cycles. When all of them are steady already only their
+ *        columns of the playing table are rewritten, otherwise they go into one render and switch
+ *        in the same PWM period, at the end of a loop of the playing table
+ * 
+ * @param [in] led_mask BIT(led) for every LED to set
+ * @param [in] duty_cycles Duty cycle per LED, 0 - LED_WAVE_MAX, indexed by led_id, only entries in
+ *             led_mask are read
+ * 
+ * @return Error code, < 0 on failures
+ */
+int led_seq_set_many(uint32_t led_mask, const uint16_t duty_cycles[NUM_LEDS]) {
+  if (IS_INVALID_MASK(led_mask)) {
+    return -EINVAL;
+  }
+
+  led_wave waves[NUM_LEDS];
+  for (int i = 0; i < NUM_LEDS; i++) {
+    waves[i] = (led_wave){.type=LED_WAVE_STEADY, .to=duty_cycles[i]};
+  }
+  return led_seq_play_many(led_mask, waves);
+}
+
+/**
+ * @brief Plays any waveform on an LED from the sequencer, the other LEDs carry on where they are
+ * 
+ * @param [in] led The LED to play the waveform on
+ * @param [in] wave The waveform, copied
+ * 
+ * @return Error code, -ENOMEM if the waveform doesn't fit next to the other running patterns
+ */
+int led_seq_play(led_id led, const led_wave *wave) {
+  if (IS_INVALID_LED(led) || NULL == wave || IS_INVALID_WAVE(wave)) {
+    return -EINVAL;
+  }
+
+  led_wave waves[NUM_LEDS];
+  waves[led] = *wave;
+  return led_seq_play_many(BIT(led), waves);
+}
+
+/**
+ * @brief Plays waveforms on several LEDs with a single render, they all start in the same PWM period.
+ *        The new table takes over at the end of a loop of the playing one, the PWM keeps running.
+ *        Steady levels over LEDs that are steady already are patched into the playing table instead
+ * 
+ * @param [in] led_mask BIT(led) for every LED to play a waveform on
+ * @param [in] waves Waveform per LED, indexed by led_id, only entries in led_mask are read
+ * 
+ * @return Error code, -ENOMEM if the waveforms don't fit next to the other running patterns
+ */
+int led_seq_play_many(uint32_t led_mask, const led_wave waves[NUM_LEDS]) {
+  if (IS_INVALID_MASK(led_mask) || NULL == waves) {
+    return -EINVAL;
+  }
+  for (int i = 0; i < NUM_LEDS; i++) {
+    if ((led_mask & BIT(i)) && IS_INVALID_WAVE(&waves[i])) {
+      return -EINVAL;
+    }
+  }
+
+  k_mutex_lock(&_seq_lock, K_FOREVER);
+  k_spinlock_key_t key = k_spin_lock(&_seq_switch_lock);
+  bool idle = _seq_next < 0;
+  // Neither sequence has loaded the waiting table yet, so it never played and is taken back
+  bool taken_back = !idle && _seq_installed[0] == _seq_installed[1];
+  if (taken_back) {
+    _seq_next = -1;
+  }
+  uint8_t free = 0;
+  while (free == _seq_installed[0] || free == _seq_installed[1]) {
+    free++;
+  }
+  if (free == _seq_fading) {
+    _seq_fading = -1; // Left the PWM before its fades were retired, don't patch what gets rendered there
+  }
+  k_spin_unlock(&_seq_switch_lock, key);
+
+  seq_table *latest = &_seq_tables[_seq_latest];
+  // Steady over steady only changes numbers in the playing table, nothing has to restart
+  if (idle && _seq_patchable(latest, led_mask, waves)) {
+    _seq_patch(latest, led_mask, waves);
+    k_mutex_unlock(&_seq_lock);
+    return 0;
+  }
+
+  seq_channel channels[NUM_LEDS];
+  memcpy(channels, latest->channels, sizeof(channels));
+  if (!taken_back) {
+    _seq_carry(channels); // Takes over once the latest table played a whole loop
+  }
+  for (int i = 0; i < NUM_LEDS; i++) {
+    if (led_mask & BIT(i)) {
+      channels[i].wave = waves[i];
+      channels[i].phase_ms = 0;
+    }
+  }
+
+  int rv = _seq_render(&_seq_tables[free], channels);
+  if (rv < 0) {
+    if (taken_back) {
+      _seq_switch(_seq_latest); // Rendering failed before it touched anything, the old one waits again
+    }
+  } else {
+    _seq_latest = free;
+    _seq_switch(free);
+  }
+  k_mutex_unlock(&_seq_lock);
+  return rv;
+}
\ No newline at end of file
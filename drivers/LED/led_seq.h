@@ -0,0 +1,30 @@
+/*
+Header to define the nRF PWM sequencer backend of the led module
+*/
+
+#ifndef LED_SEQ_H
+#define LED_SEQ_H
+
+#include "stdint.h"
+
+#include "LED.h"
+#include "led_wave.h"
+
+/* ----------------------------------------------------------------------------
+                              Backend Functions
+---------------------------------------------------------------------------- */
+int led_seq_init();
+
+int led_seq_carrier_check(uint32_t frequency_hz, uint16_t resolution);
+
+int led_seq_carrier(uint32_t frequency_hz, uint16_t resolution);
+
+int led_seq_set(led_id led, uint16_t duty_cycle);
+
+int led_seq_set_many(uint32_t led_mask, const uint16_t duty_cycles[NUM_LEDS]);
+
+int led_seq_play(led_id led, const led_wave *wave);
+
+int led_seq_play_many(uint32_t led_mask, const led_wave waves[NUM_LEDS]);
+
+#endif
@@ -0,0 +1,252 @@
+/*
+Waveform math of the led module, both the blink thread and the sequencer backend sample these
+*/
+
+#include <zephyr/kernel.h>
+#include <inttypes.h>
+
+#include "LED.h"
+#include "led_wave.h"
+#include "led_gamma_lut.h"
+
+/* ----------------------------------------------------------------------------
+                                    Constants
+---------------------------------------------------------------------------- */
+#define WAVE_ONE        BIT(16) // Ramp progress is 16.16 fixed point, this is 1.0
+#define WAVE_LUT_SHIFT  8 // Brightness bits below the gamma table index
+
+BUILD_ASSERT(LED_GAMMA_LUT_SIZE == (1 << (16 - WAVE_LUT_SHIFT)) + 1, "Gamma table doesn't match the brightness width");
+
+/* ----------------------------------------------------------------------------
+                            Private Function Prototypes
+---------------------------------------------------------------------------- */
+static uint32_t _wave_curve(led_curve curve, uint32_t x, uint32_t span, uint32_t rate);
+
+static uint16_t _wave_lerp(uint16_t from, uint16_t to, uint32_t progress);
+
+/* ----------------------------------------------------------------------------
+                              Private Functions
+---------------------------------------------------------------------------- */
+/**
+ * @brief Shapes the progress through a ramp. The ramp length comes with its reciprocal so a sample
+ *        costs a multiply instead of a 64 bit divide
+ * 
+ * @param [in] curve The shape of the ramp
+ * @param [in] x Progress, 0 - span
+ * @param [in] span Length of the ramp
+ * @param [in] rate 2^32 / span rounded up, from led_wave_prepare()
+ * 
+ * @return Shaped progress, 0 - WAVE_ONE
+ */
+static uint32_t _wave_curve(led_curve curve, uint32_t x, uint32_t span, uint32_t rate) {
+  // Rounding the rate up keeps p below WAVE_ONE until the end for ramps shorter than 65 s
+  uint64_t p = x >= span ? WAVE_ONE : MIN(((uint64_t)x * rate) >> 16, WAVE_ONE);
+
+  switch (curve) {
+    case LED_CURVE_EASE_IN:
+      return (p * p) >> 16;
+    case LED_CURVE_EASE_IN_OUT:
+      // Smoothstep, 3p^2 - 2p^3
+      return (p * p * (3 * WAVE_ONE - 2 * p)) >> 32;
+    case LED_CURVE_LINEAR:
+    default:
+      return p;
+  }
+}
+
+/**
+ * @brief Interpolates between two levels
+ * 
+ * @param [in] from Level at 0
+ * @param [in] to Level at WAVE_ONE
+ * @param [in] progress Position between the two
+ * 
+ * @return The level at that position
+ */
+static uint16_t _wave_lerp(uint16_t from, uint16_t to, uint32_t progress) {
+  int32_t delta = (int32_t)to - (int32_t)from;
+  return from + (int32_t)(((int64_t)delta * progress) >> 16);
+}
+
+/* ----------------------------------------------------------------------------
+                              Wave Functions
+---------------------------------------------------------------------------- */
+/**
+ * @brief Works out the ramp rate of a breath or fade, once when it is built instead of on every
+ *        sample. Other waveforms are left alone
+ * 
+ * @param [in,out] wave The waveform
+ */
+void led_wave_prepare(led_wave *wave) {
+  uint32_t span;
+
+  switch (wave->type) {
+    case LED_WAVE_BREATHE:
+      span = wave->period_ms / 2;
+      break;
+    case LED_WAVE_FADE:
+      span = wave->period_ms;
+      break;
+    default:
+      return;
+  }
+  wave->ramp_rate = span ? MIN(DIV_ROUND_UP(BIT64(32), span), UINT32_MAX) : 0;
+}
+
+/**
+ * @brief Samples a waveform. Breaths and fades ramp in perceived brightness and go through the
+ *        gamma table on the way out
+ * 
+ * @param [in] wave The waveform
+ * @param [in] t_ms Position in the waveform's loop, 0 - led_wave_loop_ms(). The caller wraps it
+ *             by subtracting whole loops, a fade may also be sampled any time after its end
+ * 
+ * @return The duty cycle at that time, 0 - LED_WAVE_MAX
+ */
+uint16_t led_wave_sample(const led_wave *wave, uint32_t t_ms) {
+  switch (wave->type) {
+    case LED_WAVE_BLINK:
+      return t_ms < wave->on_ms ? wave->to : wave->from;
+    case LED_WAVE_BREATHE: {
+      // Rises for the first half of the period and mirrors back down for the second
+      uint32_t half = wave->period_ms / 2;
+      uint32_t x = t_ms < half ? t_ms : wave->period_ms - MIN(t_ms, wave->period_ms);
+      return led_wave_gamma(_wave_lerp(wave->from, wave->to, _wave_curve(wave->curve, x, half, wave->ramp_rate)));
+    }
+    case LED_WAVE_FADE:
+      return led_wave_gamma(_wave_lerp(wave->from, wave->to,
+                                       _wave_curve(wave->curve, t_ms, wave->period_ms, wave->ramp_rate)));
+    case LED_WAVE_STEADY:
+    default:
+      return wave->to;
+  }
+}
+
+/**
+ * @brief Converts perceived brightness to duty cycle, interpolating between the entries of the
+ *        generated gamma table
+ * 
+ * @param [in] brightness Perceived brightness, 0 - LED_WAVE_MAX
+ * 
+ * @return Duty cycle, 0 - LED_WAVE_MAX
+ */
+uint16_t led_wave_gamma(uint16_t brightness) {
+  uint32_t index = brightness >> WAVE_LUT_SHIFT;
+  uint32_t fraction = brightness & BIT_MASK(WAVE_LUT_SHIFT);
+
+  if (LED_WAVE_MAX == brightness) {
+    return led_gamma_lut[LED_GAMMA_LUT_SIZE - 1];
+  }
+  int32_t delta = (int32_t)led_gamma_lut[index + 1] - (int32_t)led_gamma_lut[index];
+  return led_gamma_lut[index] + ((delta * (int32_t)fraction) >> WAVE_LUT_SHIFT);
+}
+
+/**
+ * @brief Scales a full-scale count by a duty cycle without dividing, LED_WAVE_MAX maps to all of it
+ * 
+ * @param [in] full The count at full duty cycle, a PWM period or counter top
+ * @param [in] duty Duty cycle, 0 - LED_WAVE_MAX
+ * 
+ * @return full * duty / LED_WAVE_MAX, rounded down
+ */
+uint32_t led_wave_scale(uint32_t full, uint16_t duty) {
+  // Stretch 0 - 0xFFFF onto 0 - 0x10000 so the shift lands exactly on both ends
+  uint32_t stretched = (uint32_t)duty + (duty >> 15);
+  return ((uint64_t)full * stretched) >> 16;
+}
+
+/**
+ * @brief Finds when a waveform next changes level, for sleeping until then. Ramps change every
+ *        CONFIG_LED_WAVE_STEP_MS, a blink only at its two edges
+ * 
+ * @param [in] wave The waveform
+ * @param [in] t_ms Position in the waveform's loop, like led_wave_sample()
+ * 
+ * @return Position of the next change, > t_ms, the loop length for a change at the start of the
+ *         next loop, UINT32_MAX if it never changes again
+ */
+uint32_t led_wave_next_ms(const led_wave *wave, uint32_t t_ms) {
+  switch (wave->type) {
+    case LED_WAVE_BLINK:
+      return t_ms < wave->on_ms ? wave->on_ms : wave->period_ms;
+    case LED_WAVE_BREATHE:
+      return (t_ms / CONFIG_LED_WAVE_STEP_MS + 1) * CONFIG_LED_WAVE_STEP_MS;
+    case LED_WAVE_FADE:
+      if (t_ms >= wave->period_ms) {
+        return UINT32_MAX;
+      }
+      return MIN((t_ms / CONFIG_LED_WAVE_STEP_MS + 1) * CONFIG_LED_WAVE_STEP_MS, wave->period_ms);
+    case LED_WAVE_STEADY:
+    default:
+      return UINT32_MAX;
+  }
+}
+
+/**
+ * @brief Length after which a waveform repeats. A fade is played as its ramp followed by an equally
+ *        long hold at the final level, so whoever loops it has a whole ramp's time to retire it
+ * 
+ * @param [in] wave The waveform
+ * 
+ * @return Loop length in ms, 0 for steady waveforms
+ */
+uint32_t led_wave_loop_ms(const led_wave *wave) {
+  switch (wave->type) {
+    case LED_WAVE_BLINK:
+    case LED_WAVE_BREATHE:
+      return wave->period_ms;
+    case LED_WAVE_FADE:
+      return 2 * wave->period_ms;
+    case LED_WAVE_STEADY:
+    default:
+      return 0;
+  }
+}
+
+/**
+ * @brief Largest sampling step that still hits every level change of a waveform. Ramps are sampled
+ *        every CONFIG_LED_WAVE_STEP_MS
+ * 
+ * @param [in] wave The waveform
+ * 
+ * @return Step in ms, 0 for steady waveforms
+ */
+uint32_t led_wave_grid_ms(const led_wave *wave) {
+  switch (wave->type) {
+    case LED_WAVE_BLINK:
+      return led_wave_gcd(wave->period_ms, wave->on_ms);
+    case LED_WAVE_BREATHE:
+    case LED_WAVE_FADE:
+      return led_wave_gcd(wave->period_ms, CONFIG_LED_WAVE_STEP_MS);
+    case LED_WAVE_STEADY:
+    default:
+      return 0;
+  }
+}
+
+/**
+ * @brief Greatest common divisor, gcd(0, b) == b. Binary GCD, only shifts and subtractions
+ * 
+ * @param [in] a First value
+ * @param [in] b Second value
+ * 
+ * @return The greatest common divisor of a and b
+ */
+uint32_t led_wave_gcd(uint32_t a, uint32_t b) {
+  if (0 == a || 0 == b) {
+    return a | b;
+  }
+
+  uint32_t shift = find_lsb_set(a | b) - 1; // Factors of two both share
+  a >>= find_lsb_set(a) - 1;
+  while (b) {
+    b >>= find_lsb_set(b) - 1;
+    if (a > b) {
+      uint32_t t = a;
+      a = b;
+      b = t;
+    }
+    b -= a;
+  }
+  return a << shift;
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+/*
+Header to define led waveforms, shared by the blink thread and the sequencer backend
+*/
+
+#ifndef LED_WAVE_H
+#define LED_WAVE_H
+
+#include "stdint.h"
+
+#include "LED.h"
+
+/* ----------------------------------------------------------------------------
+                                    Constants
+---------------------------------------------------------------------------- */
+#define LED_WAVE_MAX      UINT16_MAX // Full duty cycle or brightness
+
+/* ----------------------------------------------------------------------------
+                                    TYPES
+---------------------------------------------------------------------------- */
+typedef enum led_wave_type_t {
+  LED_WAVE_STEADY = 0,
+  LED_WAVE_BLINK,
+  LED_WAVE_BREATHE,
+  LED_WAVE_FADE,
+} led_wave_type;
+
+typedef struct led_wave_t {
+  led_wave_type type;
+  // Steady and blink levels are duty cycles, breath and fade levels are perceived brightness.
+  // Both are 0 - LED_WAVE_MAX
+  uint16_t from; // Off level of a blink, low point of a breath, start of a fade
+  uint16_t to; // Steady level, on level of a blink, high point of a breath, end of a fade
+  led_curve curve;
+  uint32_t period_ms; // Blink or breath period, fade duration
+  uint32_t on_ms; // Blink only
+  uint32_t ramp_rate; // Breath and fade only, 2^32 / ramp length rounded up, from led_wave_prepare()
+} led_wave;
+
+/* ----------------------------------------------------------------------------
+                              Wave Functions
+---------------------------------------------------------------------------- */
+void led_wave_prepare(led_wave *wave);
+
+uint16_t led_wave_sample(const led_wave *wave, uint32_t t_ms);
+
+uint16_t led_wave_gamma(uint16_t brightness);
+
+uint32_t led_wave_scale(uint32_t full, uint16_t duty);
+
+uint32_t led_wave_next_ms(const led_wave *wave, uint32_t t_ms);
+
+uint32_t led_wave_loop_ms(const led_wave *wave);
+
+uint32_t led_wave_grid_ms(const led_wave *wave);
+
+uint32_t led_wave_gcd(uint32_t a, uint32_t b);
+
+#endif
\ No newline at end of file
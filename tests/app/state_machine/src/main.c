@@ -0,0 +1,98 @@
+/*
+ * main.c
+ *
+ * Benchmark of the state machine dispatch. The machine is walked into each leaf state and fed
+ * events that reach it without running an action, so only the table lookup and the way up
+ * through the parent states is timed. Actions print and drive the LEDs, that would swamp it.
+ * Timed with the target's cycle counter, results are printed per leaf.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <zephyr/timing/timing.h>
+
+#include "BTN.h"
+#include "LED.h"
+#include "my_state_machine.h"
+
+#define RUNS     1000
+#define SETTLE   K_MSEC(100)   // the LED service thread catches up between states
+
+#define EVENT_INIT(t, b)   {.btn = (b), .type = (t), .mask = BIT(b)}
+#define EVENT(t, b)        ((btn_event)EVENT_INIT(t, b))
+
+static const btn_event b3_press = EVENT_INIT(BTN_EVENT_PRESS, BTN3);
+static const btn_event chord = {.btn = BTN0, .type = BTN_EVENT_CHORD, .mask = BIT(BTN0) | BIT(BTN1)};
+
+// Releases aren't diagram events, event_of() turns them away before the table
+static const btn_event release = EVENT_INIT(BTN_EVENT_RELEASE, BTN0);
+
+static void run(const btn_event *evt)
+{
+    zassert_ok(state_machine_run(evt));
+    k_sleep(SETTLE);
+}
+
+// Mean cost of one state_machine_run() in ns
+static uint64_t time_runs(const btn_event *evt)
+{
+    uint64_t cycles = 0;
+
+    for (int i = 0; i < RUNS; i++) {
+        timing_t start = timing_counter_get();
+        state_machine_run(evt);
+        timing_t end = timing_counter_get();
+        cycles += timing_cycles_get(&start, &end);
+    }
+    return timing_cycles_to_ns(cycles) / RUNS;
+}
+
+static void report(const char *leaf, const btn_event *ignored)
+{
+    uint64_t release_ns = time_runs(&release);
+
+    if (ignored) {
+        TC_PRINT("%s: ignored event %llu ns, release %llu ns\n", leaf, time_runs(ignored), release_ns);
+    } else {
+        TC_PRINT("%s: release %llu ns\n", leaf, release_ns);
+    }
+}
+
+static void *setup(void)
+{
+    zassert_ok(BTN_init());
+    zassert_ok(LED_init());
+    state_machine_init();
+    timing_init();
+    timing_start();
+    return NULL;
+}
+
+static void teardown(void *fixture)
+{
+    timing_stop();
+}
+
+ZTEST(state_machine, test_dispatch)
+{
+    // State_0, every diagram event runs an action here
+    zassert_equal(state_machine_activity(), SM_ACTIVITY_ENTRY);
+    report("State_0", NULL);
+
+    // State_1, three levels deep, ignores a long BTN2 press itself
+    run(&b3_press);
+    zassert_equal(state_machine_activity(), SM_ACTIVITY_ENTRY);
+    report("State_1", &EVENT(BTN_EVENT_LONG_PRESS, BTN2));
+
+    // State_2, two levels deep, ignores bits
+    run(&b3_press);
+    zassert_equal(state_machine_activity(), SM_ACTIVITY_IDLE);
+    report("State_2", &EVENT(BTN_EVENT_PRESS, BTN0));
+
+    // State_3, top level, ignores auto-repeat
+    run(&chord);
+    zassert_equal(state_machine_activity(), SM_ACTIVITY_STANDBY);
+    report("State_3", &EVENT(BTN_EVENT_REPEAT, BTN0));
+}
+
+ZTEST_SUITE(state_machine, NULL, setup, NULL, NULL, teardown);
@@ -0,0 +1,386 @@
+/*
+ * main.c
+ *
+ * Simulated central for the ble_metrics bsim suite. Connects to the app, subscribes to the stream
+ * characteristic, enters one character over the button characteristic, plays LED frames, then
+ * disconnects so the app prints its stream and LED metrics. The
+ * tests_scripts check the app's ble_metric lines, this image only checks the stream it received.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "bs_types.h"
+#include "bs_tracing.h"
+#include "time_machine.h"
+#include "bstests.h"
+#include "babblekit/flags.h"
+#include "babblekit/testcase.h"
+
+#include "ble_service.h"
+
+extern enum bst_result_t bst_result;
+
+#define WAIT_TIME             (15 * 1000 * 1000)   // us of simulated time before the test fails
+
+#define PERIPHERAL_NAME       "2012 EiE BLE Peripheral"   // CONFIG_BT_DEVICE_NAME of the app
+
+// UUIDs and entry layouts from ble_service.c
+#define SERVICE_UUID \
+    BT_UUID_128_ENCODE(0x12345678, 0x1234, 0x5678, 0x1234, 0x56789abcdef0)
+#define STREAM_UUID \
+    BT_UUID_128_ENCODE(0x12345678, 0x1234, 0x5678, 0x1234, 0x56789abcdef3)
+#define LED_FRAME_UUID \
+    BT_UUID_128_ENCODE(0x12345678, 0x1234, 0x5678, 0x1234, 0x56789abcdef4)
+#define BUTTON_UUID \
+    BT_UUID_128_ENCODE(0x12345678, 0x1234, 0x5678, 0x1234, 0x56789abcdef5)
+
+#define LED_FRAME_ENTRY_SIZE  8
+#define BUTTON_ENTRY_SIZE     6
+
+#define NUM_LEDS              4
+#define LED_FRAMES            50
+#define LED_FRAME_INTERVAL_MS 20
+#define LED_FADE_MS           100
+#define LED_LEVEL_STEP        4096   // perceived brightness, 0 - UINT16_MAX
+
+// Far enough apart that no press turns into a double click, long press or repeat
+#define PRESS_SPACING_US      300000
+#define PRESS_HOLD_US         50000
+#define BUTTON_B0             0
+#define BUTTON_B1             1
+#define BUTTON_B3             3
+#define CODE                  'A'   // entered most significant bit first, B0 for 0 and B1 for 1
+#define CODE_BITS             8
+
+static struct bt_uuid_128 service_uuid = BT_UUID_INIT_128(SERVICE_UUID);
+static struct bt_uuid_128 stream_uuid = BT_UUID_INIT_128(STREAM_UUID);
+static struct bt_uuid_128 led_frame_uuid = BT_UUID_INIT_128(LED_FRAME_UUID);
+static struct bt_uuid_128 button_uuid = BT_UUID_INIT_128(BUTTON_UUID);
+
+DEFINE_FLAG_STATIC(flag_connected);
+DEFINE_FLAG_STATIC(flag_disconnected);
+DEFINE_FLAG_STATIC(flag_discovered);
+DEFINE_FLAG_STATIC(flag_subscribed);
+DEFINE_FLAG_STATIC(flag_char_record);
+DEFINE_FLAG_STATIC(flag_state_record);
+
+static struct bt_conn *conn;
+
+static uint16_t service_end;
+static uint16_t stream_handle;
+static uint16_t led_frame_handle;
+static uint16_t button_handle;
+
+static struct bt_gatt_discover_params discover_params;
+static struct bt_gatt_discover_params ccc_discover_params;
+static struct bt_gatt_subscribe_params subscribe_params;
+
+// Stream reassembly, records may span two notifications
+static uint8_t record[2 + UINT8_MAX];
+static size_t record_len;
+static uint32_t notifications;
+static uint32_t stream_bytes;
+
+/* ---------- scanning and connection ---------- */
+static bool name_matches(struct bt_data *data, void *user_data)
+{
+    bool *found = user_data;
+
+    if (data->type == BT_DATA_NAME_COMPLETE && data->data_len == strlen(PERIPHERAL_NAME) &&
+        0 == memcmp(data->data, PERIPHERAL_NAME, data->data_len)) {
+        *found = true;
+        return false;
+    }
+    return true;
+}
+
+static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
+                         struct net_buf_simple *ad)
+{
+    bool found = false;
+
+    if (conn || (type != BT_GAP_ADV_TYPE_ADV_IND && type != BT_GAP_ADV_TYPE_ADV_DIRECT_IND)) {
+        return;
+    }
+    bt_data_parse(ad, name_matches, &found);
+    if (!found) {
+        return;
+    }
+
+    int err = bt_le_scan_stop();
+    TEST_ASSERT(err == 0, "Scan stop failed (%d)", err);
+
+    err = bt_conn_le_create(addr, BT_CONN_LE_CREATE_CONN, BT_LE_CONN_PARAM_DEFAULT, &conn);
+    TEST_ASSERT(err == 0, "Connection not started (%d)", err);
+}
+
+static void connected(struct bt_conn *connection, uint8_t err)
+{
+    TEST_ASSERT(err == 0, "Connection failed (0x%02x)", err);
+    SET_FLAG(flag_connected);
+}
+
+static void disconnected(struct bt_conn *connection, uint8_t reason)
+{
+    bt_conn_unref(conn);
+    conn = NULL;
+    SET_FLAG(flag_disconnected);
+}
+
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+    .connected = connected,
+    .disconnected = disconnected,
+};
+
+/* ---------- discovery ---------- */
+static uint8_t characteristic_found(struct bt_conn *connection, const struct bt_gatt_attr *attr,
+                                    struct bt_gatt_discover_params *params)
+{
+    if (!attr) {
+        SET_FLAG(flag_discovered);
+        return BT_GATT_ITER_STOP;
+    }
+
+    const struct bt_gatt_chrc *chrc = attr->user_data;
+    if (0 == bt_uuid_cmp(chrc->uuid, &stream_uuid.uuid)) {
+        stream_handle = chrc->value_handle;
+    } else if (0 == bt_uuid_cmp(chrc->uuid, &led_frame_uuid.uuid)) {
+        led_frame_handle = chrc->value_handle;
+    } else if (0 == bt_uuid_cmp(chrc->uuid, &button_uuid.uuid)) {
+        button_handle = chrc->value_handle;
+    }
+    return BT_GATT_ITER_CONTINUE;
+}
+
+static uint8_t service_found(struct bt_conn *connection, const struct bt_gatt_attr *attr,
+                             struct bt_gatt_discover_params *params)
+{
+    TEST_ASSERT(attr != NULL, "Service not found");
+
+    const struct bt_gatt_service_val *service = attr->user_data;
+    service_end = service->end_handle;
+
+    discover_params.uuid = NULL;
+    discover_params.func = characteristic_found;
+    discover_params.start_handle = attr->handle + 1;
+    discover_params.end_handle = service_end;
+    discover_params.type = BT_GATT_DISCOVER_CHARACTERISTIC;
+
+    int err = bt_gatt_discover(connection, &discover_params);
+    TEST_ASSERT(err == 0, "Characteristic discovery not started (%d)", err);
+    return BT_GATT_ITER_STOP;
+}
+
+static void discover(void)
+{
+    discover_params.uuid = &service_uuid.uuid;
+    discover_params.func = service_found;
+    discover_params.start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE;
+    discover_params.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE;
+    discover_params.type = BT_GATT_DISCOVER_PRIMARY;
+
+    int err = bt_gatt_discover(conn, &discover_params);
+    TEST_ASSERT(err == 0, "Service discovery not started (%d)", err);
+
+    WAIT_FOR_FLAG(flag_discovered);
+    TEST_ASSERT(stream_handle && led_frame_handle && button_handle,
+                "Characteristics missing: stream %u, LED frame %u, button %u",
+                stream_handle, led_frame_handle, button_handle);
+}
+
+/* ---------- stream ---------- */
+// Bytes the current record needs in total, 0 for an unknown record type
+static size_t record_size(void)
+{
+    switch (record[0]) {
+    case BLE_STREAM_CHAR:
+        return 6;
+    case BLE_STREAM_CLEARED:
+        return 1;
+    case BLE_STREAM_STATE:
+        return 8;
+    case BLE_STREAM_SNAPSHOT:
+        return record_len < 2 ? 2 : 2 + record[1];
+    default:
+        return 0;
+    }
+}
+
+static void stream_byte(uint8_t byte)
+{
+    record[record_len++] = byte;
+
+    size_t size = record_size();
+    TEST_ASSERT(size != 0, "Unknown stream record 0x%02x", record[0]);
+    if (record_len < size) {
+        return;
+    }
+
+    if (record[0] == BLE_STREAM_CHAR) {
+        SET_FLAG(flag_char_record);
+    } else if (record[0] == BLE_STREAM_STATE) {
+        SET_FLAG(flag_state_record);
+    }
+    record_len = 0;
+}
+
+static uint8_t stream_notified(struct bt_conn *connection, struct bt_gatt_subscribe_params *params,
+                               const void *data, uint16_t length)
+{
+    if (!data) {
+        return BT_GATT_ITER_STOP;   // unsubscribed
+    }
+
+    notifications++;
+    stream_bytes += length;
+    for (uint16_t i = 0; i < length; i++) {
+        stream_byte(((const uint8_t *)data)[i]);
+    }
+    return BT_GATT_ITER_CONTINUE;
+}
+
+static void stream_subscribed(struct bt_conn *connection, uint8_t err,
+                              struct bt_gatt_subscribe_params *params)
+{
+    TEST_ASSERT(err == 0, "Subscribe failed (0x%02x)", err);
+    SET_FLAG(flag_subscribed);
+}
+
+static void subscribe(void)
+{
+    subscribe_params.notify = stream_notified;
+    subscribe_params.subscribe = stream_subscribed;
+    subscribe_params.value = BT_GATT_CCC_NOTIFY;
+    subscribe_params.value_handle = stream_handle;
+    subscribe_params.ccc_handle = BT_GATT_AUTO_DISCOVER_CCC_HANDLE;
+    subscribe_params.end_handle = service_end;
+    subscribe_params.disc_params = &ccc_discover_params;
+
+    int err = bt_gatt_subscribe(conn, &subscribe_params);
+    TEST_ASSERT(err == 0, "Subscribe not started (%d)", err);
+    WAIT_FOR_FLAG(flag_subscribed);
+}
+
+/* ---------- buttons and LEDs ---------- */
+// One write per press, its release follows at an offset. Fits the default 20-byte payload
+static void press(uint8_t button)
+{
+    uint8_t entries[2 * BUTTON_ENTRY_SIZE];
+
+    entries[0] = button;
+    entries[1] = true;
+    sys_put_le32(0, &entries[2]);
+    entries[BUTTON_ENTRY_SIZE] = button;
+    entries[BUTTON_ENTRY_SIZE + 1] = false;
+    sys_put_le32(PRESS_HOLD_US, &entries[BUTTON_ENTRY_SIZE + 2]);
+
+    int err = bt_gatt_write_without_response(conn, button_handle, entries, sizeof(entries), false);
+    TEST_ASSERT(err == 0, "Press of B%u not sent (%d)", button, err);
+    k_sleep(K_USEC(PRESS_SPACING_US));
+}
+
+// Eight bits make a character, B3 saves it and moves the state machine on
+static void press_code(void)
+{
+    for (int i = CODE_BITS - 1; i >= 0; i--) {
+        press((CODE >> i) & 1 ? BUTTON_B1 : BUTTON_B0);
+    }
+    press(BUTTON_B3);
+
+    WAIT_FOR_FLAG(flag_char_record);
+    WAIT_FOR_FLAG(flag_state_record);
+}
+
+// Every LED in a frame fades towards a new level, the app times each frame from write to PWM.
+// Frames cover as many LEDs as one write holds at the negotiated MTU
+static void play_frames(void)
+{
+    uint8_t frame[NUM_LEDS * LED_FRAME_ENTRY_SIZE];
+    int leds = MIN(NUM_LEDS, (bt_gatt_get_mtu(conn) - 3) / LED_FRAME_ENTRY_SIZE);
+
+    for (int i = 0; i < LED_FRAMES; i++) {
+        for (int led = 0; led < leds; led++) {
+            uint8_t *entry = &frame[led * LED_FRAME_ENTRY_SIZE];
+            entry[0] = led;
+            entry[1] = 0;   // linear
+            uint16_t from = (i + led * 4) * LED_LEVEL_STEP;   // wraps around, LEDs apart
+            sys_put_le16(from, &entry[2]);
+            sys_put_le16(from + LED_LEVEL_STEP, &entry[4]);
+            sys_put_le16(LED_FADE_MS, &entry[6]);
+        }
+
+        int err = bt_gatt_write_without_response(conn, led_frame_handle, frame,
+                                                 leds * LED_FRAME_ENTRY_SIZE, false);
+        TEST_ASSERT(err == 0, "LED frame %d not sent (%d)", i, err);
+        k_sleep(K_MSEC(LED_FRAME_INTERVAL_MS));
+    }
+}
+
+/* ---------- test ---------- */
+static void test_central_main(void)
+{
+    int err = bt_enable(NULL);
+    TEST_ASSERT(err == 0, "Bluetooth init failed (%d)", err);
+
+    err = bt_le_scan_start(BT_LE_SCAN_PASSIVE, device_found);
+    TEST_ASSERT(err == 0, "Scanning not started (%d)", err);
+    WAIT_FOR_FLAG(flag_connected);
+
+    discover();
+    subscribe();
+    press_code();
+    play_frames();
+
+    // Lets the last frames and notifications through before the app reports
+    k_sleep(K_SECONDS(1));
+    err = bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+    TEST_ASSERT(err == 0, "Disconnect failed (%d)", err);
+    WAIT_FOR_FLAG(flag_disconnected);
+
+    TEST_ASSERT(record_len == 0, "Stream ended inside a record");
+    TEST_PASS("%u notifications, %u stream bytes", notifications, stream_bytes);
+}
+
+static void test_central_init(void)
+{
+    bst_ticker_set_next_tick_absolute(WAIT_TIME);
+}
+
+static void test_central_tick(bs_time_t HW_device_time)
+{
+    if (bst_result != Passed) {
+        TEST_FAIL("Not passed after %d seconds", WAIT_TIME / 1000000);
+    }
+}
+
+static const struct bst_test_instance test_def[] = {
+    {
+        .test_id = "central",
+        .test_descr = "Connects to the app and drives its stream, button and LED characteristics",
+        .test_pre_init_f = test_central_init,
+        .test_tick_f = test_central_tick,
+        .test_main_f = test_central_main,
+    },
+    BSTEST_END_MARKER,
+};
+
+static struct bst_test_list *test_central_install(struct bst_test_list *tests)
+{
+    return bst_add_tests(tests, test_def);
+}
+
+bst_test_install_t test_installers[] = {test_central_install, NULL};
+
+int main(void)
+{
+    bst_main();
+    return 0;
+}
@@ -0,0 +1,25 @@
+#!/usr/bin/env bash
+# SPDX-License-Identifier: Apache-2.0
+
+# Compiles the app as the peripheral and the simulated central in each MTU / PHY variant.
+# Needs a west workspace with this module, ZEPHYR_BASE and the BabbleSim environment set up
+
+set -ue
+: "${ZEPHYR_BASE:?ZEPHYR_BASE must be set to point to the zephyr root directory}"
+
+source ${ZEPHYR_BASE}/tests/bsim/compile.source
+
+app_root=$(realpath $(dirname "${BASH_SOURCE[0]}")/../../..)
+BOARD_TS="${BOARD:-nrf52_bsim}"
+BOARD_TS="${BOARD_TS//\//_}"
+
+app=app conf_overlay=${app_root}/tests/bsim/ble_metrics/peripheral.conf \
+  exe_name=bs_${BOARD_TS}_ble_metrics_peripheral compile
+app=tests/bsim/ble_metrics/central \
+  exe_name=bs_${BOARD_TS}_ble_metrics_central compile
+app=tests/bsim/ble_metrics/central conf_overlay=overlay-mtu23.conf \
+  exe_name=bs_${BOARD_TS}_ble_metrics_central_mtu23 compile
+app=tests/bsim/ble_metrics/central conf_overlay=overlay-1m.conf \
+  exe_name=bs_${BOARD_TS}_ble_metrics_central_1m compile
+
+wait_for_background_jobs
@@ -0,0 +1,7 @@
+#!/usr/bin/env bash
+# SPDX-License-Identifier: Apache-2.0
+
+# The app against a central that supports everything it asks for
+source $(dirname "${BASH_SOURCE[0]}")/_ble_metrics.source
+
+run_ble_metrics "" mtu=247 tx_len=251 phy=2
@@ -0,0 +1,7 @@
+#!/usr/bin/env bash
+# SPDX-License-Identifier: Apache-2.0
+
+# Setup and throughput when the central stays on the 1M PHY
+source $(dirname "${BASH_SOURCE[0]}")/_ble_metrics.source
+
+run_ble_metrics _1m mtu=247 tx_len=251 phy=1
@@ -0,0 +1,7 @@
+#!/usr/bin/env bash
+# SPDX-License-Identifier: Apache-2.0
+
+# Notification throughput at the default 23-byte ATT MTU
+source $(dirname "${BASH_SOURCE[0]}")/_ble_metrics.source
+
+run_ble_metrics _mtu23 mtu=23 tx_len=251 phy=2
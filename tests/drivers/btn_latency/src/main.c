@@ -0,0 +1,96 @@
+/*
+ * main.c
+ *
+ * Benchmark of the BTN debounce backends. The test presses the buttons by setting the levels of
+ * the emulated GPIO pins and times every press from the pin change to the BTN_callback_set()
+ * callback. testcase.yaml builds it once per backend, each run prints its own numbers.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+
+#include "BTN.h"
+
+#define PRESSES          100
+#define HOLD             K_MSEC(50)    // shorter than a long press
+#define GAP              K_MSEC(300)   // longer than a double click window
+#define EVENT_TIMEOUT    K_MSEC(200)
+#define LATENCY_MAX_US   (50 * USEC_PER_MSEC)   // above every backend's debounce time
+
+#if defined(CONFIG_BTN_DEBOUNCE_WORK)
+#define BACKEND   "work"
+#elif defined(CONFIG_BTN_DEBOUNCE_SAMPLED)
+#define BACKEND   "sampled"
+#elif defined(CONFIG_BTN_DEBOUNCE_LOCKOUT)
+#define BACKEND   "lockout"
+#elif defined(CONFIG_BTN_DEBOUNCE_INPUT)
+#define BACKEND   "input"
+#endif
+
+#define PIN_SPEC(node)   GPIO_DT_SPEC_GET(node, gpios)
+
+// The same pins the driver reads, in button order
+static const struct gpio_dt_spec pins[NUM_BTNS] = {
+    DT_FOREACH_CHILD_STATUS_OKAY_SEP(BTN_NODE, PIN_SPEC, (,))
+};
+
+static K_SEM_DEFINE(pressed, 0, 1);
+static K_SEM_DEFINE(released, 0, 1);
+static uint32_t pressed_at;   // cycles, set by the callback
+static btn_id pressed_btn;
+
+static void on_event(const btn_event *evt, void *user_data)
+{
+    if (evt->type == BTN_EVENT_PRESS) {
+        pressed_at = k_cycle_get_32();
+        pressed_btn = evt->btn;
+        k_sem_give(&pressed);
+    } else if (evt->type == BTN_EVENT_RELEASE) {
+        k_sem_give(&released);
+    }
+}
+
+static void *setup(void)
+{
+    zassert_ok(BTN_init());
+    BTN_callback_set(on_event, NULL);
+    return NULL;
+}
+
+ZTEST(btn_latency, test_press_to_callback)
+{
+    uint32_t min_us = UINT32_MAX;
+    uint32_t max_us = 0;
+    uint64_t total_us = 0;
+
+    for (int i = 0; i < PRESSES; i++) {
+        const struct gpio_dt_spec *pin = &pins[i % NUM_BTNS];
+
+        uint32_t start = k_cycle_get_32();
+        zassert_ok(gpio_emul_input_set(pin->port, pin->pin, 1));
+        zassert_ok(k_sem_take(&pressed, EVENT_TIMEOUT), "press %d never reached the callback", i);
+        uint32_t latency_us = k_cyc_to_us_floor32(pressed_at - start);
+        zassert_equal(pressed_btn, i % NUM_BTNS);
+
+        k_sleep(HOLD);
+        zassert_ok(gpio_emul_input_set(pin->port, pin->pin, 0));
+        zassert_ok(k_sem_take(&released, EVENT_TIMEOUT), "release %d never reached the callback", i);
+        k_sleep(GAP);
+
+        min_us = MIN(min_us, latency_us);
+        max_us = MAX(max_us, latency_us);
+        total_us += latency_us;
+    }
+
+    btn_latency stats;
+    BTN_latency_get(&stats);
+    TC_PRINT("%s backend: press to callback min %u us, mean %u us, max %u us over %d presses\n",
+             BACKEND, min_us, (uint32_t)(total_us / PRESSES), max_us, PRESSES);
+    TC_PRINT("%s backend: BTN_latency_get() mean %u us, max %u us over %u presses\n", BACKEND,
+             stats.count ? (uint32_t)(stats.total_us / stats.count) : 0, stats.max_us, stats.count);
+    zassert_true(max_us < LATENCY_MAX_US, "a press took %u us", max_us);
+}
+
+ZTEST_SUITE(btn_latency, NULL, setup, NULL, NULL, NULL);
@@ -0,0 +1,141 @@
+/*
+ * main.c
+ *
+ * Tests for the LED API under load. Threads above the service thread call the LED functions
+ * faster than the service thread can keep up, every call has to get through and every LED has to
+ * end on the last value its thread asked for.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <zephyr/fff.h>
+#include <zephyr/irq_offload.h>
+#include <zephyr/drivers/pwm/pwm_fake.h>
+
+#include "LED.h"
+
+DEFINE_FFF_GLOBALS;
+
+#define ITERATIONS       300
+#define STACK_SIZE       1024
+#define PRIORITY         K_PRIO_PREEMPT(0)   // above the service thread, like main
+#define QUEUE_SIZE       CONFIG_LED_CMD_QUEUE_SIZE
+#define SETTLE           K_MSEC(100)         // longer than any fade the threads start
+
+// Last value the fake PWM controller got per channel, the LEDs sit on channels 0 - 3
+static uint32_t periods[NUM_LEDS];
+static uint32_t pulses[NUM_LEDS];
+
+// Each thread owns one LED and leaves it at its own duty cycle
+static const uint8_t final_duty_cycles[NUM_LEDS] = {100, 0, 25, 75};
+
+static int failures[NUM_LEDS];
+static int first_error[NUM_LEDS];
+
+static int isr_result;
+
+K_THREAD_STACK_ARRAY_DEFINE(stacks, NUM_LEDS, STACK_SIZE);
+static struct k_thread threads[NUM_LEDS];
+
+static int record_pwm(const struct device *dev, uint32_t channel, uint32_t period, uint32_t pulse,
+                      pwm_flags_t flags)
+{
+    if (channel < NUM_LEDS) {
+        periods[channel] = period;
+        pulses[channel] = pulse;
+    }
+    return 0;
+}
+
+// LEDs are active low, the pulse is the off share of the period
+static uint32_t duty_cycle_of(led_id led)
+{
+    zassert_not_equal(periods[led], 0, "LED%d never written", led);
+    return 100 - (uint32_t)(((uint64_t)pulses[led] * 100 + periods[led] / 2) / periods[led]);
+}
+
+static void check(led_id led, int err)
+{
+    if (err && 0 == failures[led]++) {
+        first_error[led] = err;
+    }
+}
+
+static void hammer(void *p1, void *p2, void *p3)
+{
+    led_id led = POINTER_TO_UINT(p1);
+    uint8_t duty_cycles[NUM_LEDS] = {0};
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        check(led, LED_pwm(led, i % 101));
+        check(led, LED_toggle(led));
+        check(led, LED_blink_custom(led, 100, 50));
+        check(led, LED_fade(led, 0, 100, 50, LED_CURVE_EASE_IN));
+        duty_cycles[led] = (i * 7) % 101;
+        check(led, LED_set_many(BIT(led), duty_cycles));
+        check(led, LED_commit());
+    }
+
+    // Any thread's commit loads every staged LED, its own commit comes after its own stage
+    duty_cycles[led] = final_duty_cycles[led];
+    check(led, LED_set_many(BIT(led), duty_cycles));
+    check(led, LED_commit());
+}
+
+static void toggle_from_isr(const void *p)
+{
+    isr_result = LED_toggle(POINTER_TO_UINT(p));
+}
+
+static void *setup(void)
+{
+    zassert_ok(LED_init());
+    return NULL;
+}
+
+static void before(void *fixture)
+{
+    k_sleep(SETTLE);   // the service thread drains whatever the last test queued
+    fake_pwm_set_cycles_fake.custom_fake = record_pwm;   // the fake is reset before every test
+    k_thread_priority_set(k_current_get(), PRIORITY);
+}
+
+ZTEST(led_api, test_threads)
+{
+    for (int i = 0; i < NUM_LEDS; i++) {
+        failures[i] = 0;
+        k_thread_create(&threads[i], stacks[i], K_THREAD_STACK_SIZEOF(stacks[i]), hammer,
+                        UINT_TO_POINTER(i), NULL, NULL, PRIORITY, 0, K_NO_WAIT);
+    }
+    for (int i = 0; i < NUM_LEDS; i++) {
+        zassert_ok(k_thread_join(&threads[i], K_SECONDS(30)), "LED%d thread stuck", i);
+    }
+    k_sleep(SETTLE);
+
+    for (int i = 0; i < NUM_LEDS; i++) {
+        zassert_equal(failures[i], 0, "LED%d: %d calls failed, first with %d", i, failures[i],
+                      first_error[i]);
+        zassert_equal(duty_cycle_of(i), final_duty_cycles[i], "LED%d", i);
+    }
+}
+
+ZTEST(led_api, test_full_queue)
+{
+    // The service thread can't run until this thread waits, so the queue fills up
+    for (int i = 0; i < QUEUE_SIZE; i++) {
+        zassert_ok(LED_set(LED0, i & 1), "command %d of %d", i, QUEUE_SIZE);
+    }
+
+    // An ISR can't wait for room
+    irq_offload(toggle_from_isr, UINT_TO_POINTER(LED1));
+    zassert_equal(isr_result, -EAGAIN);
+
+    // A thread waits for the service thread instead, so nothing is lost
+    zassert_ok(LED_set(LED1, LED_ON));
+    zassert_ok(LED_set(LED0, LED_ON));
+    k_sleep(SETTLE);
+    zassert_equal(duty_cycle_of(LED0), 100);
+    zassert_equal(duty_cycle_of(LED1), 100);
+}
+
+ZTEST_SUITE(led_api, NULL, setup, before, NULL, NULL);
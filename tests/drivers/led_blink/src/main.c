@@ -0,0 +1,146 @@
+/*
+ * main.c
+ *
+ * Benchmark of the software blink. The service thread blinks an LED at 1 Hz for a minute of
+ * simulated time, every edge it writes to the fake PWM controller is timed against the ideal
+ * edge and every time the thread is switched in counts as a wakeup. The blink loop the driver
+ * had before deadline scheduling runs the same minute as a reference and both results are
+ * printed side by side.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <zephyr/fff.h>
+#include <zephyr/drivers/pwm/pwm_fake.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "LED.h"
+
+DEFINE_FFF_GLOBALS;
+
+#define RUN_S            60
+#define HALF_PERIOD_MS   500    // LED_1HZ
+#define STACK_SIZE       1024
+#define PRIORITY         K_PRIO_PREEMPT(1)   // the service thread's
+
+// The old loop counted in 10 us units and always slept one 16 Hz half period
+#define BASELINE_UNIT               100   // units per ms
+#define BASELINE_HALF_PERIOD_1HZ    (HALF_PERIOD_MS * BASELINE_UNIT)
+#define BASELINE_HALF_PERIOD_16HZ   (500 * BASELINE_UNIT / 16)
+
+typedef struct {
+    int64_t first;           // ticks of the first edge
+    uint32_t edges;
+    uint32_t wakeups;
+    int64_t max_error_us;    // largest distance of an edge from where it belongs
+    int64_t last_error_us;   // of the last edge, the phase drift over the run
+} blink_stats;
+
+static blink_stats stats;
+static bool running;
+static k_tid_t led_thread;   // the service thread, the only one writing the PWM
+
+K_THREAD_STACK_DEFINE(baseline_stack, STACK_SIZE);
+static struct k_thread baseline_thread;
+
+static void edge(void)
+{
+    int64_t now = k_uptime_ticks();
+
+    if (stats.edges == 0) {
+        stats.first = now;
+    }
+    int64_t ideal = stats.first + k_ms_to_ticks_near64((uint64_t)stats.edges * HALF_PERIOD_MS);
+    int64_t error_us = (now - ideal) * USEC_PER_SEC / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
+
+    stats.max_error_us = MAX(stats.max_error_us, llabs(error_us));
+    stats.last_error_us = error_us;
+    stats.edges++;
+}
+
+static int record_pwm(const struct device *dev, uint32_t channel, uint32_t period, uint32_t pulse,
+                      pwm_flags_t flags)
+{
+    if (running && channel == LED0) {
+        led_thread = k_current_get();
+        edge();
+    }
+    return 0;
+}
+
+// Called with interrupts locked on every context switch
+void sys_trace_thread_switched_in_user(void)
+{
+    if (running && led_thread != NULL && k_current_get() == led_thread) {
+        stats.wakeups++;
+    }
+}
+
+// The blink loop before deadline scheduling, a relative sleep and an offset accumulator. It keeps
+// the old arithmetic and only records the edge where the old one toggled the LED
+static void baseline_loop(void *p1, void *p2, void *p3)
+{
+    uint16_t offset = 0;
+
+    edge();   // the blink starts on
+    while (1) {
+        k_msleep(BASELINE_HALF_PERIOD_16HZ / BASELINE_UNIT);
+        stats.wakeups++;
+        offset += BASELINE_HALF_PERIOD_16HZ;
+        if (offset >= BASELINE_HALF_PERIOD_1HZ) {
+            offset = 0;
+            edge();
+        }
+    }
+}
+
+static void print(const char *name)
+{
+    uint32_t per_s_x100 = stats.wakeups * 100 / RUN_S;
+
+    TC_PRINT("%s: %u edges, %u wakeups (%u.%02u/s), phase error max %lld us, after %d s %lld us\n",
+             name, stats.edges, stats.wakeups, per_s_x100 / 100, per_s_x100 % 100,
+             stats.max_error_us, RUN_S, stats.last_error_us);
+}
+
+static void *setup(void)
+{
+    zassert_ok(LED_init());
+    return NULL;
+}
+
+static void before(void *fixture)
+{
+    memset(&stats, 0, sizeof(stats));
+    led_thread = NULL;
+    fake_pwm_set_cycles_fake.custom_fake = record_pwm;   // the fake is reset before every test
+}
+
+ZTEST(led_blink, test_deadline_loop)
+{
+    running = true;
+    zassert_ok(LED_blink(LED0, LED_1HZ));
+    k_sleep(K_SECONDS(RUN_S));
+    running = false;
+    zassert_ok(LED_set(LED0, LED_OFF));
+
+    print("deadline loop");
+    zassert_within(stats.edges, 2 * RUN_S, 1);
+    zassert_true(stats.wakeups <= stats.edges, "%u wakeups for %u edges", stats.wakeups, stats.edges);
+    zassert_true(stats.max_error_us < USEC_PER_MSEC, "edge %lld us off", stats.max_error_us);
+}
+
+ZTEST(led_blink, test_baseline_loop)
+{
+    running = true;
+    k_thread_create(&baseline_thread, baseline_stack, K_THREAD_STACK_SIZEOF(baseline_stack),
+                    baseline_loop, NULL, NULL, NULL, PRIORITY, 0, K_NO_WAIT);
+    k_sleep(K_SECONDS(RUN_S));
+    running = false;
+    k_thread_abort(&baseline_thread);
+
+    print("baseline loop");
+}
+
+ZTEST_SUITE(led_blink, NULL, setup, before, NULL, NULL);
@@ -0,0 +1,219 @@
+/*
+ * main.c
+ *
+ * Tests for led_ring, the command queue of the LED driver. Producer threads and a timer ISR push
+ * numbered items while a consumer thread drains them the way the LED service thread does, every
+ * producer's items have to come out exactly once and in the order they went in.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <string.h>
+
+#include "led_ring.h"
+
+#define RING_SIZE            16
+#define PRODUCERS            4
+#define ITEMS_PER_PRODUCER   5000
+#define TIMER_ITEMS          200
+#define TIMER_PRODUCER       PRODUCERS   // producer id of the timer ISR
+#define TOTAL_ITEMS          (PRODUCERS * ITEMS_PER_PRODUCER + TIMER_ITEMS)
+#define STACK_SIZE           1024
+#define PRIORITY             K_PRIO_PREEMPT(1)   // producers and consumer alike, like the driver's callers
+
+typedef struct {
+    uint32_t producer;
+    uint32_t sequence;   // counts up from 0 per producer
+} ring_item;
+
+static ring_item items[RING_SIZE];
+static atomic_t sequences[RING_SIZE];
+static led_ring ring;
+static K_SEM_DEFINE(wake, 0, 1);   // given for every pushed item, like the service thread's
+
+static atomic_t full_count;   // pushes that found the ring full
+
+// Consumer only until it is joined
+static uint32_t expected[PRODUCERS + 1];
+static uint32_t consumed;
+static bool out_of_order;
+static ring_item bad_item;
+
+static uint32_t timer_next;   // timer ISR only
+
+K_THREAD_STACK_ARRAY_DEFINE(producer_stacks, PRODUCERS, STACK_SIZE);
+static struct k_thread producer_threads[PRODUCERS];
+K_THREAD_STACK_DEFINE(consumer_stack, STACK_SIZE);
+static struct k_thread consumer_thread;
+
+// Same steps as _led_cmd_push() and _led_cmd_pop() in led.c
+static int push(const ring_item *item)
+{
+    uint32_t position;
+    int err = led_ring_claim(&ring, &position);
+    if (err) {
+        return err;
+    }
+
+    items[position % RING_SIZE] = *item;
+    led_ring_publish(&ring, position);
+    k_sem_give(&wake);
+    return 0;
+}
+
+static bool pop(ring_item *item)
+{
+    uint32_t position;
+    if (!led_ring_take(&ring, &position)) {
+        return false;
+    }
+
+    *item = items[position % RING_SIZE];
+    led_ring_free(&ring);
+    return true;
+}
+
+static void producer(void *p1, void *p2, void *p3)
+{
+    ring_item item = {.producer = POINTER_TO_UINT(p1), .sequence = 0};
+
+    while (item.sequence < ITEMS_PER_PRODUCER) {
+        if (0 == push(&item)) {
+            item.sequence++;
+        } else {
+            // Full, the same item again once the consumer had a turn
+            atomic_inc(&full_count);
+            k_yield();
+        }
+    }
+}
+
+static void timer_producer(struct k_timer *timer)
+{
+    ring_item item = {.producer = TIMER_PRODUCER, .sequence = timer_next};
+
+    if (0 != push(&item)) {
+        atomic_inc(&full_count);   // retried on the next expiry
+    } else if (++timer_next == TIMER_ITEMS) {
+        k_timer_stop(timer);
+    }
+}
+
+static K_TIMER_DEFINE(timer, timer_producer, NULL);
+
+static void consumer(void *p1, void *p2, void *p3)
+{
+    ring_item item;
+
+    while (consumed < TOTAL_ITEMS) {
+        k_sem_take(&wake, K_FOREVER);
+        while (pop(&item)) {
+            // A lost item skips a number, a duplicated or reordered one repeats or goes back
+            if (item.producer > TIMER_PRODUCER || item.sequence != expected[item.producer]) {
+                out_of_order = true;
+                bad_item = item;
+                return;
+            }
+            expected[item.producer]++;
+            consumed++;
+        }
+    }
+}
+
+static void before(void *fixture)
+{
+    zassert_ok(led_ring_init(&ring, sequences, RING_SIZE));
+    k_sem_reset(&wake);
+    atomic_set(&full_count, 0);
+    memset(expected, 0, sizeof(expected));
+    consumed = 0;
+    out_of_order = false;
+    timer_next = 0;
+}
+
+ZTEST(led_ring, test_init_size)
+{
+    zassert_equal(led_ring_init(&ring, sequences, 0), -EINVAL);
+    zassert_equal(led_ring_init(&ring, sequences, 12), -EINVAL);
+    zassert_ok(led_ring_init(&ring, sequences, RING_SIZE));
+}
+
+ZTEST(led_ring, test_full)
+{
+    ring_item item;
+    uint32_t position;
+
+    for (uint32_t i = 0; i < RING_SIZE; i++) {
+        zassert_ok(push(&(ring_item){.producer = 0, .sequence = i}), "push %u of %u", i, RING_SIZE);
+    }
+    zassert_equal(led_ring_claim(&ring, &position), -EAGAIN, "claimed past a full ring");
+
+    // One item out frees exactly one position
+    zassert_true(pop(&item));
+    zassert_equal(item.sequence, 0);
+    zassert_ok(push(&(ring_item){.producer = 0, .sequence = RING_SIZE}));
+    zassert_equal(led_ring_claim(&ring, &position), -EAGAIN, "claimed past a full ring");
+
+    for (uint32_t i = 1; i <= RING_SIZE; i++) {
+        zassert_true(pop(&item), "item %u missing", i);
+        zassert_equal(item.sequence, i);
+    }
+    zassert_false(pop(&item), "took from an empty ring");
+}
+
+ZTEST(led_ring, test_unpublished_holds_back)
+{
+    uint32_t first, second, position;
+
+    zassert_ok(led_ring_claim(&ring, &first));
+    zassert_ok(led_ring_claim(&ring, &second));
+    zassert_equal(second, first + 1);
+
+    // The later producer finishes first, the consumer still waits for the older item
+    led_ring_publish(&ring, second);
+    zassert_false(led_ring_take(&ring, &position), "took past an unpublished item");
+
+    led_ring_publish(&ring, first);
+    zassert_true(led_ring_take(&ring, &position));
+    zassert_equal(position, first);
+    led_ring_free(&ring);
+    zassert_true(led_ring_take(&ring, &position));
+    zassert_equal(position, second);
+    led_ring_free(&ring);
+    zassert_false(led_ring_take(&ring, &position));
+}
+
+ZTEST(led_ring, test_producers)
+{
+    k_thread_create(&consumer_thread, consumer_stack, K_THREAD_STACK_SIZEOF(consumer_stack),
+                    consumer, NULL, NULL, NULL, PRIORITY, 0, K_NO_WAIT);
+    for (int i = 0; i < PRODUCERS; i++) {
+        k_thread_create(&producer_threads[i], producer_stacks[i], K_THREAD_STACK_SIZEOF(producer_stacks[i]),
+                        producer, UINT_TO_POINTER(i), NULL, NULL, PRIORITY, 0, K_NO_WAIT);
+    }
+    k_timer_start(&timer, K_MSEC(1), K_MSEC(1));
+
+    // The consumer only returns once every item is out or one came out wrong
+    int err = k_thread_join(&consumer_thread, K_SECONDS(30));
+    k_timer_stop(&timer);
+    if (err) {
+        k_thread_abort(&consumer_thread);
+    }
+    for (int i = 0; i < PRODUCERS; i++) {
+        k_thread_abort(&producer_threads[i]);   // done already unless the consumer stopped early
+    }
+
+    zassert_false(out_of_order, "producer %u item %u came out, expected %u", bad_item.producer,
+                  bad_item.sequence, bad_item.producer > TIMER_PRODUCER ? 0 : expected[bad_item.producer]);
+    zassert_ok(err, "consumer stuck after %u of %u items", consumed, TOTAL_ITEMS);
+    for (int i = 0; i <= TIMER_PRODUCER; i++) {
+        zassert_equal(expected[i], i == TIMER_PRODUCER ? TIMER_ITEMS : ITEMS_PER_PRODUCER,
+                      "producer %d", i);
+    }
+
+    uint32_t position;
+    zassert_false(led_ring_take(&ring, &position), "items left over");
+    TC_PRINT("%u items, the ring was full %ld times\n", consumed, (long)atomic_get(&full_count));
+}
+
+ZTEST_SUITE(led_ring, NULL, NULL, before, NULL, NULL);
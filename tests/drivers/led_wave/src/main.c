@@ -0,0 +1,158 @@
+/*
+ * main.c
+ *
+ * Tests for the waveform math of the LED driver. The gamma table has to stay monotonic once it is
+ * interpolated, ramps have to start and end exactly on their levels whatever their length and
+ * curve, and the binary GCD has to agree with Euclid's on the edge cases the grid math hits.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include "led_wave.h"
+
+#define FROM   0x1000
+#define TO     0xF000
+
+static const led_curve curves[] = {LED_CURVE_LINEAR, LED_CURVE_EASE_IN, LED_CURVE_EASE_IN_OUT};
+
+// Ramp lengths around the rounding of the ramp rate, up to the 65 s it is exact for
+static const uint32_t periods_ms[] = {1, 2, 3, 7, 10, 250, 1000, 4095, 65000};
+
+static led_wave wave(led_wave_type type, uint16_t from, uint16_t to, led_curve curve, uint32_t period_ms)
+{
+    led_wave w = {.type = type, .from = from, .to = to, .curve = curve, .period_ms = period_ms};
+    led_wave_prepare(&w);
+    return w;
+}
+
+static uint32_t euclid(uint32_t a, uint32_t b)
+{
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+ZTEST(led_wave, test_gamma_monotonic)
+{
+    zassert_equal(led_wave_gamma(0), 0);
+    zassert_equal(led_wave_gamma(LED_WAVE_MAX), LED_WAVE_MAX);
+
+    // Every brightness, interpolated ones between the table entries included
+    uint16_t previous = led_wave_gamma(0);
+    for (uint32_t b = 1; b <= LED_WAVE_MAX; b++) {
+        uint16_t duty = led_wave_gamma(b);
+        zassert_true(duty >= previous, "gamma(%u) = %u, below gamma(%u) = %u", b, duty, b - 1, previous);
+        previous = duty;
+    }
+}
+
+ZTEST(led_wave, test_fade_endpoints)
+{
+    for (size_t c = 0; c < ARRAY_SIZE(curves); c++) {
+        for (size_t p = 0; p < ARRAY_SIZE(periods_ms); p++) {
+            uint32_t period = periods_ms[p];
+            led_wave up = wave(LED_WAVE_FADE, FROM, TO, curves[c], period);
+            led_wave down = wave(LED_WAVE_FADE, TO, FROM, curves[c], period);
+
+            zassert_equal(led_wave_sample(&up, 0), led_wave_gamma(FROM), "curve %zu, %u ms", c, period);
+            zassert_equal(led_wave_sample(&up, period), led_wave_gamma(TO), "curve %zu, %u ms", c, period);
+            zassert_equal(led_wave_sample(&down, 0), led_wave_gamma(TO), "curve %zu, %u ms", c, period);
+            zassert_equal(led_wave_sample(&down, period), led_wave_gamma(FROM), "curve %zu, %u ms", c, period);
+
+            // Held at the end, through the hold of the loop and any time after it
+            zassert_equal(led_wave_sample(&up, led_wave_loop_ms(&up)), led_wave_gamma(TO));
+            zassert_equal(led_wave_sample(&up, UINT32_MAX), led_wave_gamma(TO));
+
+            // Never overshoots on the way, whatever the rounding of the rate
+            uint16_t previous = led_wave_sample(&up, 0);
+            for (uint32_t t = 1; t <= MIN(period, 1000); t++) {
+                uint16_t duty = led_wave_sample(&up, t);
+                zassert_true(duty >= previous && duty <= led_wave_gamma(TO),
+                             "curve %zu, %u ms: %u at %u ms after %u", c, period, duty, t, previous);
+                previous = duty;
+            }
+        }
+    }
+}
+
+ZTEST(led_wave, test_breathe_endpoints)
+{
+    for (size_t c = 0; c < ARRAY_SIZE(curves); c++) {
+        for (size_t p = 0; p < ARRAY_SIZE(periods_ms); p++) {
+            uint32_t period = 2 * periods_ms[p];
+            led_wave breath = wave(LED_WAVE_BREATHE, FROM, TO, curves[c], period);
+
+            zassert_equal(led_wave_sample(&breath, 0), led_wave_gamma(FROM), "curve %zu, %u ms", c, period);
+            zassert_equal(led_wave_sample(&breath, period / 2), led_wave_gamma(TO), "curve %zu, %u ms", c, period);
+            zassert_equal(led_wave_sample(&breath, period), led_wave_gamma(FROM), "curve %zu, %u ms", c, period);
+            zassert_equal(led_wave_loop_ms(&breath), period);
+        }
+    }
+
+    // Full range, nothing wraps at either end
+    led_wave full = wave(LED_WAVE_BREATHE, 0, LED_WAVE_MAX, LED_CURVE_EASE_IN_OUT, 2000);
+    zassert_equal(led_wave_sample(&full, 0), 0);
+    zassert_equal(led_wave_sample(&full, 1000), LED_WAVE_MAX);
+}
+
+ZTEST(led_wave, test_scale_endpoints)
+{
+    static const uint32_t fulls[] = {1, 255, 1000, 16000, UINT16_MAX, UINT32_MAX};
+
+    for (size_t i = 0; i < ARRAY_SIZE(fulls); i++) {
+        zassert_equal(led_wave_scale(fulls[i], 0), 0);
+        zassert_equal(led_wave_scale(fulls[i], LED_WAVE_MAX), fulls[i], "full %u", fulls[i]);
+        zassert_true(led_wave_scale(fulls[i], LED_WAVE_MAX / 2) <= fulls[i] / 2 + 1, "full %u", fulls[i]);
+    }
+}
+
+ZTEST(led_wave, test_gcd)
+{
+    // Zero, gcd(0, b) == b
+    zassert_equal(led_wave_gcd(0, 0), 0);
+    zassert_equal(led_wave_gcd(0, 7), 7);
+    zassert_equal(led_wave_gcd(7, 0), 7);
+    zassert_equal(led_wave_gcd(0, UINT32_MAX), UINT32_MAX);
+
+    // Equal values
+    zassert_equal(led_wave_gcd(1, 1), 1);
+    zassert_equal(led_wave_gcd(12, 12), 12);
+    zassert_equal(led_wave_gcd(BIT(31), BIT(31)), BIT(31));
+    zassert_equal(led_wave_gcd(UINT32_MAX, UINT32_MAX), UINT32_MAX);
+
+    // Coprime values
+    zassert_equal(led_wave_gcd(1, 1000), 1);
+    zassert_equal(led_wave_gcd(13, 17), 1);
+    zassert_equal(led_wave_gcd(35, 64), 1);
+    zassert_equal(led_wave_gcd(UINT32_MAX, UINT32_MAX - 1), 1);
+
+    // Shared factors of two and odd ones
+    zassert_equal(led_wave_gcd(48, 18), 6);
+    zassert_equal(led_wave_gcd(BIT(31), BIT(30)), BIT(30));
+    zassert_equal(led_wave_gcd(1000, 10), 10);
+
+    for (uint32_t a = 0; a <= 200; a++) {
+        for (uint32_t b = 0; b <= 200; b++) {
+            zassert_equal(led_wave_gcd(a, b), euclid(a, b), "gcd(%u, %u)", a, b);
+        }
+    }
+}
+
+ZTEST(led_wave, test_grid)
+{
+    led_wave blink = {.type = LED_WAVE_BLINK, .period_ms = 1000, .on_ms = 250};
+    led_wave odd_blink = {.type = LED_WAVE_BLINK, .period_ms = 1001, .on_ms = 500};
+    led_wave fade = wave(LED_WAVE_FADE, FROM, TO, LED_CURVE_LINEAR, 1003);
+    led_wave steady = {.type = LED_WAVE_STEADY, .to = TO};
+
+    zassert_equal(led_wave_grid_ms(&blink), 250);
+    zassert_equal(led_wave_grid_ms(&odd_blink), 1);
+    zassert_equal(led_wave_grid_ms(&fade), euclid(1003, CONFIG_LED_WAVE_STEP_MS));
+    zassert_equal(led_wave_grid_ms(&steady), 0);
+}
+
+ZTEST_SUITE(led_wave, NULL, NULL, NULL, NULL, NULL);